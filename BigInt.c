@@ -1,7 +1,11 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // mremap
+#endif
+
 #include <assert.h>
-#include <math.h>
 #include <errno.h>
 #include <limits.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,15 +13,27 @@
 #include "BigInt.h"
 #include "safe_math_impl.h"
 
+#if BIGINT_PTHREADS
+#include <pthread.h>
+#endif
+
+#if BIGINT_MAPPED
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
 
-#if UNIT_MAX >> 32 == 0
+#if UINT_MAX >> 32 == 0
 #    define check_add_int_int check_add_int32_int32
 #    define check_add_uint_uint check_add_uint32_uint32
 #    define check_mul_int_int check_mul_int32_int32
 #    define check_mul_uint_uint check_mul_uint32_uint32
 #else
-#    if UNIT_MAX >> 64 == 0
+#    if UINT_MAX >> 64 == 0
 #        define check_add_int_int check_add_int64_int64
 #        define check_add_uint_uint check_add_uint64_uint64
 #        define check_mul_int_int check_mul_int64_int64
@@ -27,33 +43,223 @@
 #    endif
 #endif
 
+// digit counts are size_t
+#if SIZE_MAX == UINT32_MAX
+#    define check_add_size_size check_add_uint32_uint32
+#    define check_mul_size_size check_mul_uint32_uint32
+#elif SIZE_MAX == UINT64_MAX
+#    define check_add_size_size check_add_uint64_uint64
+#    define check_mul_size_size check_mul_uint64_uint64
+#else
+#    error unsupported size_t size
+#endif
+
+#if BIGINT_REPR == BIGINT_REPR_DECIMAL
+// wide enough to hold digit * digit + digit + digit without overflow
+typedef unsigned int BigInt_double_digit;
+#define BIGINT_BASE 10u
+// number of decimal digits held by each element of digits
+#define BIGINT_DECIMAL_WIDTH 1
+#define BIGINT_CHUNK_BASE BIGINT_BASE
+#define BIGINT_CHUNK_WIDTH BIGINT_DECIMAL_WIDTH
+#elif BIGINT_REPR == BIGINT_REPR_BINARY64
+#if !defined(__SIZEOF_INT128__)
+#error BIGINT_REPR_BINARY64 requires a compiler with unsigned __int128
+#endif
+typedef unsigned __int128 BigInt_double_digit;
+#define BIGINT_BASE (((BigInt_double_digit)1) << 64)
+// digits is not a power of ten, so decimal I/O goes through chunks of
+// BIGINT_CHUNK_WIDTH decimal digits (the largest power of ten in a limb)
+#define BIGINT_DECIMAL_WIDTH 0
+#define BIGINT_CHUNK_BASE 10000000000000000000ull
+#define BIGINT_CHUNK_WIDTH 19
+#elif BIGINT_REPR == BIGINT_REPR_BASE1E9
+typedef uint64_t BigInt_double_digit;
+#define BIGINT_BASE 1000000000u
+#define BIGINT_DECIMAL_WIDTH 9
+#define BIGINT_CHUNK_BASE BIGINT_BASE
+#define BIGINT_CHUNK_WIDTH BIGINT_DECIMAL_WIDTH
+#elif BIGINT_REPR == BIGINT_REPR_BASE1E19
+#if !defined(__SIZEOF_INT128__)
+#error BIGINT_REPR_BASE1E19 requires a compiler with unsigned __int128
+#endif
+typedef unsigned __int128 BigInt_double_digit;
+#define BIGINT_BASE 10000000000000000000ull
+#define BIGINT_DECIMAL_WIDTH 19
+#define BIGINT_CHUNK_BASE BIGINT_BASE
+#define BIGINT_CHUNK_WIDTH BIGINT_DECIMAL_WIDTH
+#elif BIGINT_REPR == BIGINT_REPR_PACKED_BCD
+// each element is a base 100 digit encoded as two BCD nibbles
+typedef unsigned int BigInt_double_digit;
+#define BIGINT_BASE 100u
+#define BIGINT_DECIMAL_WIDTH 2
+#define BIGINT_CHUNK_BASE BIGINT_BASE
+#define BIGINT_CHUNK_WIDTH BIGINT_DECIMAL_WIDTH
+#endif
+
+// wide enough to hold digit * UINT_MAX + UINT_MAX for the *_int kernels,
+// and twice as wide as a word that holds any digit value or unsigned int
+#if BIGINT_REPR == BIGINT_REPR_BINARY64 || BIGINT_REPR == BIGINT_REPR_BASE1E19
+typedef BigInt_double_digit BigInt_int_product;
+typedef uint64_t BigInt_int_word;
+#else
+typedef uint64_t BigInt_int_product;
+typedef uint32_t BigInt_int_word;
+#endif
+#define BIGINT_INT_WORD_BITS (8 * sizeof(BigInt_int_word))
+
+// Whether BigInt_digits_divide_small multiplies by a reciprocal of the
+// divisor instead of dividing.  A 64 bit processor divides a 64 bit
+// product by a 32 bit word more slowly than it multiplies, but current ones
+// divide 128 bit products by a 64 bit word about as fast as the reciprocal
+// arithmetic on them, so the representations with 64 bit digits divide.
+#ifndef BIGINT_DIVIDE_BY_RECIPROCAL
+#if BIGINT_REPR == BIGINT_REPR_BINARY64 || BIGINT_REPR == BIGINT_REPR_BASE1E19
+#define BIGINT_DIVIDE_BY_RECIPROCAL 0
+#else
+#define BIGINT_DIVIDE_BY_RECIPROCAL 1
+#endif
+#endif//BIGINT_DIVIDE_BY_RECIPROCAL
+
+#if BIGINT_REPR == BIGINT_REPR_PACKED_BCD
+// Converts between an element of digits and the value (< BIGINT_BASE) it
+// encodes.  Comparisons work on elements directly since packed BCD sorts
+// like the values it holds.
+#define BIGINT_DIGIT_VALUE(digit) ((((BigInt_digit)(digit) >> 4) * 10) + ((digit) & 0xF))
+#define BIGINT_DIGIT_FROM_VALUE(value) (BigInt_digit)((((value) / 10) << 4) | ((value) % 10))
+
+// Adds two packed BCD digits and an incoming carry nibble by nibble.
+// Returns the sum digit and sets *carry to the carry out.
+static inline BigInt_digit BigInt_digit_add(BigInt_digit a, BigInt_digit b, int* carry) {
+    unsigned int sum = a + b + *carry;
+    if((a & 0xF) + (b & 0xF) + *carry > 9) {
+        sum += 0x06; // low nibble passed 9: skip the six non-decimal codes
+    }
+    *carry = sum > 0x99;
+    if(*carry) {
+        sum += 0x60;
+    }
+    return (BigInt_digit)sum;
+}
+
+// Subtracts b and an incoming borrow from a nibble by nibble.
+// Returns the difference digit and sets *borrow to the borrow out.
+static inline BigInt_digit BigInt_digit_subtract(BigInt_digit a, BigInt_digit b, int* borrow) {
+    int low = (a & 0xF) - (b & 0xF) - *borrow;
+    int high = (a >> 4) - (b >> 4);
+    if(low < 0) {
+        low += 10;
+        high--;
+    }
+    *borrow = high < 0;
+    if(*borrow) {
+        high += 10;
+    }
+    return (BigInt_digit)((high << 4) | low);
+}
+#else
+#define BIGINT_DIGIT_VALUE(digit) (digit)
+#define BIGINT_DIGIT_FROM_VALUE(value) (BigInt_digit)(value)
+
+// Adds two digits and an incoming carry.
+// Returns the sum digit and sets *carry to the carry out.
+static inline BigInt_digit BigInt_digit_add(BigInt_digit a, BigInt_digit b, int* carry) {
+    BigInt_double_digit total = (BigInt_double_digit)a + b + *carry;
+    if(total >= BIGINT_BASE) {
+        total -= BIGINT_BASE;
+        *carry = 1;
+    } else {
+        *carry = 0;
+    }
+    return total;
+}
+
+// Subtracts b and an incoming borrow from a.
+// Returns the difference digit and sets *borrow to the borrow out.
+static inline BigInt_digit BigInt_digit_subtract(BigInt_digit a, BigInt_digit b, int* borrow) {
+    BigInt_double_digit to_take = (BigInt_double_digit)b + *borrow;
+    BigInt_double_digit new_digit = a;
+    // Borrow BIGINT_BASE from the next digit if necessary
+    if(new_digit < to_take) {
+        *borrow = 1;
+        new_digit += BIGINT_BASE;
+    } else {
+        *borrow = 0;
+    }
+    new_digit -= to_take;
+    assert(new_digit < BIGINT_BASE);
+    return new_digit;
+}
+#endif
+
+// BigInt_ensure_digits grows the digits buffer to at least this percentage
+// of its current size, so that repeated growth by a few digits at a time
+// (e.g. accumulating with BigInt_add) costs amortized O(1) per digit.
+// 100 disables geometric growth.
+#ifndef BIGINT_GROWTH_PERCENT
+#define BIGINT_GROWTH_PERCENT 200
+#endif//BIGINT_GROWTH_PERCENT
+
 #ifndef BIGINT_REDZONE
 #define BIGINT_REDZONE 0
 #endif//BIGINT_REDZONE
 
+//============================================================================
+// Allocators
+//============================================================================
+
+static void* BigInt_malloc_alloc(void* context, size_t size) {
+    (void)context;
+    return malloc(size);
+}
+
+static void* BigInt_malloc_realloc(void* context, void* ptr, size_t old_size, size_t new_size) {
+    (void)context;
+    (void)old_size;
+    return realloc(ptr, new_size);
+}
+
+static void BigInt_malloc_free(void* context, void* ptr, size_t size) {
+    (void)context;
+    (void)size;
+    free(ptr);
+}
+
+const BigInt_allocator BigInt_malloc_allocator = {
+    BigInt_malloc_alloc, BigInt_malloc_realloc, BigInt_malloc_free, NULL
+};
+
+// BigInt_redzone_allocator puts BIGINT_REDZONE_SIZE bytes of extra allocation
+// at the front and the back of every block.  Those "redzones" are filled
+// with an uncommon value (0x42) and checked when the block is freed or
+// reallocated to make sure they weren't modified.
 #if BIGINT_REDZONE
-// if BIGINT_REDZONE is set to a value, that value is the number of bytes
-// of extra allocation at the front and the back of the digits buffer.
-// those "redzones" will then be filled with an uncommon value (0x42)
-// when freed, those "redzones" will be checked to make sure they weren't modified
-unsigned char* malloc_digits(unsigned int num_digits) {
-    unsigned int bytes;
-    if(
-        !check_mul_uint_uint(num_digits, sizeof(unsigned char), &bytes)
-        || !check_add_uint_uint(bytes, BIGINT_REDZONE * 2, &bytes)
-    ) {
+#define BIGINT_REDZONE_SIZE BIGINT_REDZONE
+#else
+#define BIGINT_REDZONE_SIZE 16
+#endif
+
+static void* BigInt_redzone_alloc(void* context, size_t size) {
+    (void)context;
+    if(size > SIZE_MAX - BIGINT_REDZONE_SIZE * 2) {
         errno = ENOMEM;
         return NULL;
     }
+    size_t bytes = size + BIGINT_REDZONE_SIZE * 2;
     unsigned char* p = malloc(bytes);
+    if(!p) {
+        return NULL;
+    }
     memset(p, 0x42, bytes);
-    return p + BIGINT_REDZONE;
+    return p + BIGINT_REDZONE_SIZE;
 }
 
-unsigned char* okay_digits(unsigned char* digits, unsigned int num_digits) {
-    unsigned char* rz1 = digits - BIGINT_REDZONE;
-    unsigned char* rz2 = digits + num_digits * sizeof(unsigned char);
-    for(unsigned int i = 0; i < BIGINT_REDZONE; i++) {
+// Returns the start of the underlying allocation of ptr, or NULL if one of
+// its redzones was modified.
+static unsigned char* BigInt_redzone_check(void* ptr, size_t size) {
+    unsigned char* rz1 = (unsigned char*)ptr - BIGINT_REDZONE_SIZE;
+    unsigned char* rz2 = (unsigned char*)ptr + size;
+    for(unsigned int i = 0; i < BIGINT_REDZONE_SIZE; i++) {
         if(rz1[i] != 0x42) {
             fprintf(stderr, "redzone underflow\n");
             return NULL;
@@ -66,616 +272,3486 @@ unsigned char* okay_digits(unsigned char* digits, unsigned int num_digits) {
     return rz1;
 }
 
-void free_digits(unsigned char* digits, unsigned int num_digits) {
-    if(!digits) {
+static void BigInt_redzone_free(void* context, void* ptr, size_t size) {
+    if(!ptr) {
         return;
     }
-    unsigned char* p = okay_digits(digits, num_digits);
+    unsigned char* p = BigInt_redzone_check(ptr, size);
     assert(p); // redzone violation
+    (void)context;
     free(p);
 }
-#else
-#define malloc_digits(num_digits) malloc((num_digits) * sizeof(unsigned char))
-#define okay_digits(digits,num_digits) 1
-#define free_digits(digits,num_digits) free(digits)
-#endif
-
-BigInt* BigInt_construct(int value) {
 
-    BigInt* new_big_int = malloc(sizeof(BigInt));
-    if(!new_big_int) {
+static void* BigInt_redzone_realloc(void* context, void* ptr, size_t old_size, size_t new_size) {
+    void* new_ptr = BigInt_redzone_alloc(context, new_size);
+    if(!new_ptr) {
         return NULL;
     }
-    unsigned int value2;
-    if(value < 0) {
-        new_big_int->is_negative = 1;
-        value2 = -value;
-    } else {
-        new_big_int->is_negative = 0;
-        value2 = value;
+    if(ptr) {
+        memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+        BigInt_redzone_free(context, ptr, old_size);
     }
+    return new_ptr;
+}
 
-    new_big_int->num_digits = floor(log10(value2)) + 1;
+const BigInt_allocator BigInt_redzone_allocator = {
+    BigInt_redzone_alloc, BigInt_redzone_realloc, BigInt_redzone_free, NULL
+};
 
-    // Special case for 0
-    if(new_big_int->num_digits == 0) {
-        new_big_int->num_digits = 1;
-    }
+#if BIGINT_REDZONE
+static const BigInt_allocator* BigInt_registered_allocator = &BigInt_redzone_allocator;
+#else
+static const BigInt_allocator* BigInt_registered_allocator = &BigInt_malloc_allocator;
+#endif
 
-    new_big_int->num_allocated_digits = new_big_int->num_digits;
-    new_big_int->digits = malloc_digits(new_big_int->num_allocated_digits);
-    if(!new_big_int->digits) {
-        free(new_big_int);
-        return NULL;
+void BigInt_set_allocator(const BigInt_allocator* allocator) {
+    if(!allocator) {
+#if BIGINT_REDZONE
+        allocator = &BigInt_redzone_allocator;
+#else
+        allocator = &BigInt_malloc_allocator;
+#endif
     }
+    BigInt_registered_allocator = allocator;
+}
 
-    unsigned int count = new_big_int->num_digits;
-    unsigned char* digits = new_big_int->digits;
-    while(count--) {
-        (*digits++) = value2 % 10;
-        value2 /= 10;
-    }
+const BigInt_allocator* BigInt_get_allocator() {
+    return BigInt_registered_allocator;
+}
 
-    return new_big_int;
+//============================================================================
+// Shared digits buffers
+//============================================================================
+
+// Every heap digits buffer starts with this header, which counts the
+// BigInts sharing it.  BigInt_clone and BigInt_assign share a heap buffer
+// rather than copying it, and a BigInt copies its digits to a private
+// buffer (in BigInt_ensure_digits) before writing to a shared one.  The
+// count is atomic so BigInts sharing a buffer may be used from different
+// threads.
+typedef struct BigInt_digits_header {
+    atomic_size_t refs;
+} BigInt_digits_header;
+
+// Size of the header, padded so digits stay 16-byte aligned.
+#define BIGINT_DIGITS_HEADER 16
+
+// Returns the header in front of the heap digits buffer digits.
+static BigInt_digits_header* BigInt_digits_header_of(const BigInt_digit* digits) {
+    return (BigInt_digits_header*)((char*)digits - BIGINT_DIGITS_HEADER);
 }
 
-BigInt* BigInt_clone(const BigInt* big_int, unsigned int num_allocated_digits) {
-    if(num_allocated_digits < big_int->num_digits) {
-        num_allocated_digits = big_int->num_digits;
+// Returns the size in bytes of a heap buffer holding num_digits digits,
+// header included, or 0 if that doesn't fit in a size_t.
+static size_t BigInt_digits_bytes(size_t num_digits) {
+    if(num_digits > (SIZE_MAX - BIGINT_DIGITS_HEADER) / sizeof(BigInt_digit)) {
+        return 0;
     }
-    BigInt* new_big_int = malloc(sizeof(BigInt));
-    if(!new_big_int) {
-        return NULL;
+    return BIGINT_DIGITS_HEADER + num_digits * sizeof(BigInt_digit);
+}
+
+//============================================================================
+// Digit buffer cache
+//============================================================================
+
+// Freed digits buffers of up to 2^BIGINT_DIGIT_CACHE_MAX_CLASS bytes are kept
+// in a per-thread cache, bucketed by power-of-two size, and handed out again
+// instead of going back to the allocator.  Buffers in that range are always
+// allocated at their full class size so any buffer of a class fits any
+// request for it.  At most BIGINT_DIGIT_CACHE_BYTES bytes are kept per
+// thread.  BIGINT_DIGIT_CACHE (see BigInt.h) turns the cache off.
+
+#ifndef BIGINT_DIGIT_CACHE_MAX_CLASS
+#define BIGINT_DIGIT_CACHE_MAX_CLASS 16
+#endif//BIGINT_DIGIT_CACHE_MAX_CLASS
+
+#ifndef BIGINT_DIGIT_CACHE_BYTES
+#define BIGINT_DIGIT_CACHE_BYTES (1024 * 1024)
+#endif//BIGINT_DIGIT_CACHE_BYTES
+
+// smallest class; a cached buffer must have room for a BigInt_cached_digits
+// and a digits header
+#define BIGINT_DIGIT_CACHE_MIN_CLASS 5
+
+// A cached buffer, overlaid on its own first bytes.  It is handed out again
+// only to the allocator it came from, with the same context and free
+// function as when it was cached, and goes back through those.  At 32 bytes
+// this fits the smallest class.
+typedef struct BigInt_cached_digits {
+    struct BigInt_cached_digits* next;
+    const BigInt_allocator* allocator; // the allocator the buffer belongs to
+    void (*free)(void* context, void* ptr, size_t size); // its free and context
+    void* context;
+} BigInt_cached_digits;
+
+typedef struct BigInt_digit_cache {
+    BigInt_cached_digits* buckets[BIGINT_DIGIT_CACHE_MAX_CLASS + 1];
+    BigInt_digit_cache_stats stats;
+} BigInt_digit_cache;
+
+static _Thread_local BigInt_digit_cache BigInt_thread_digit_cache;
+
+// see Scratch arenas
+static void BigInt_thread_exit_register();
+
+// Returns the size class of a buffer of bytes bytes, or 0 if such buffers
+// aren't cached.
+static unsigned int BigInt_digit_cache_class(size_t bytes) {
+#if BIGINT_DIGIT_CACHE
+    if(bytes > ((size_t)1 << BIGINT_DIGIT_CACHE_MAX_CLASS)) {
+        return 0;
     }
-    new_big_int->digits = malloc_digits(num_allocated_digits);
-    if(!new_big_int->digits) {
-        free(new_big_int);
-        return NULL;
+    unsigned int size_class = BIGINT_DIGIT_CACHE_MIN_CLASS;
+    while(((size_t)1 << size_class) < bytes) {
+        size_class++;
     }
-    new_big_int->num_allocated_digits = num_allocated_digits;
-    new_big_int->is_negative = big_int->is_negative;
-    new_big_int->num_digits = big_int->num_digits;
-    memmove(new_big_int->digits, big_int->digits, big_int->num_digits * sizeof(unsigned char));
-    assert(okay_digits(new_big_int->digits, new_big_int->num_allocated_digits));
-    return new_big_int;
+    return size_class;
+#else
+    (void)bytes;
+    return 0;
+#endif
 }
 
-BigInt* BigInt_from_string(const char* str) {
-    BOOL is_negative = (*str == '-');
-    if(is_negative) {
-        str++;
+// Returns the number of digits a heap buffer holds when num_digits digits
+// are requested: a whole size class when such buffers are cached.
+static size_t BigInt_digits_capacity(size_t num_digits) {
+    size_t bytes = BigInt_digits_bytes(num_digits);
+    if(!bytes) {
+        return num_digits;
     }
-    while(*str == '0' && *str != 0) { // remove leading zeros
-        str++;
+    unsigned int size_class = BigInt_digit_cache_class(bytes);
+    if(!size_class) {
+        return num_digits;
     }
-    unsigned int num_digits = strlen( str );
-    BigInt* new_big_int = malloc(sizeof(BigInt));
-    if(!new_big_int){
-        return NULL;
+    return (((size_t)1 << size_class) - BIGINT_DIGITS_HEADER) / sizeof(BigInt_digit);
+}
+
+void BigInt_digit_cache_get_stats(BigInt_digit_cache_stats* stats) {
+    *stats = BigInt_thread_digit_cache.stats;
+}
+
+void BigInt_digit_cache_flush() {
+    BigInt_digit_cache* cache = &BigInt_thread_digit_cache;
+    for(unsigned int size_class = 0; size_class <= BIGINT_DIGIT_CACHE_MAX_CLASS; size_class++) {
+        BigInt_cached_digits* cached = cache->buckets[size_class];
+        while(cached) {
+            BigInt_cached_digits* next = cached->next;
+            cached->free(cached->context, cached, (size_t)1 << size_class);
+            cached = next;
+        }
+        cache->buckets[size_class] = NULL;
     }
-    new_big_int->is_negative = is_negative;
-    new_big_int->num_allocated_digits = num_digits;
-    new_big_int->digits = malloc_digits(num_digits);
-    if(!new_big_int->digits){
-        free(new_big_int);
+    cache->stats.cached_buffers = 0;
+    cache->stats.cached_bytes = 0;
+}
+
+// Allocates a buffer for num_digits digits from allocator, or from the
+// cache if it holds a buffer of the right class from the same allocator.
+// The buffer starts out with a single reference.  Callers that keep the
+// buffer should ask for BigInt_digits_capacity() digits so they know the
+// true size.
+static BigInt_digit* BigInt_alloc_digits(const BigInt_allocator* allocator, size_t num_digits) {
+    size_t bytes = BigInt_digits_bytes(num_digits);
+    if(!bytes) {
+        errno = ENOMEM;
         return NULL;
     }
-    const char* end = str + num_digits - 1;
-    unsigned char* digits = new_big_int->digits;
-    while( end >= str ){
-        unsigned char digit = *(end--);
-        if(digit < '0' || digit > '9'){
-            BigInt_free(new_big_int);
-            errno = EINVAL;
+    void* block = NULL;
+    unsigned int size_class = BigInt_digit_cache_class(bytes);
+    if(size_class) {
+        BigInt_digit_cache* cache = &BigInt_thread_digit_cache;
+        BigInt_cached_digits* cached = cache->buckets[size_class];
+        if(cached && cached->allocator == allocator && cached->context == allocator->context
+                && cached->free == allocator->free) {
+            cache->buckets[size_class] = cached->next;
+            cache->stats.cached_buffers--;
+            cache->stats.cached_bytes -= (size_t)1 << size_class;
+            cache->stats.hits++;
+            block = cached;
+        } else {
+            cache->stats.misses++;
+            bytes = (size_t)1 << size_class;
+        }
+    }
+    if(!block) {
+        block = allocator->alloc(allocator->context, bytes);
+        if(!block) {
             return NULL;
         }
-        *digits++ = digit - '0';
     }
-    new_big_int->num_digits = digits - new_big_int->digits;
-    assert(okay_digits(new_big_int->digits, new_big_int->num_allocated_digits));
-    return new_big_int;
+    atomic_init(&((BigInt_digits_header*)block)->refs, 1);
+    return (BigInt_digit*)((char*)block + BIGINT_DIGITS_HEADER);
 }
 
-void BigInt_free(BigInt* big_int) {
-    if(big_int) {
-        free_digits(big_int->digits, big_int->num_allocated_digits);
-        free(big_int);
+// Drops a reference to a buffer from BigInt_alloc_digits.  The last
+// reference returns it to the cache, or to allocator once the cache is full.
+static void BigInt_release_digits(const BigInt_allocator* allocator, BigInt_digit* digits, size_t num_digits) {
+    BigInt_digits_header* header = BigInt_digits_header_of(digits);
+    if(atomic_fetch_sub_explicit(&header->refs, 1, memory_order_acq_rel) > 1) {
+        return; // still shared
+    }
+    size_t bytes = BigInt_digits_bytes(num_digits);
+    unsigned int size_class = BigInt_digit_cache_class(bytes);
+    if(size_class) {
+        BigInt_digit_cache* cache = &BigInt_thread_digit_cache;
+        bytes = (size_t)1 << size_class;
+        if(cache->stats.cached_bytes + bytes <= BIGINT_DIGIT_CACHE_BYTES) {
+            BigInt_cached_digits* cached = (BigInt_cached_digits*)header;
+            cached->allocator = allocator;
+            cached->free = allocator->free;
+            cached->context = allocator->context;
+            cached->next = cache->buckets[size_class];
+            cache->buckets[size_class] = cached;
+            cache->stats.cached_buffers++;
+            cache->stats.cached_bytes += bytes;
+            cache->stats.cached_frees++;
+            BigInt_thread_exit_register();
+            return;
+        }
+        cache->stats.uncached_frees++;
     }
+    allocator->free(allocator->context, header, bytes);
 }
 
-BOOL BigInt_assign(BigInt* target, const BigInt* source)
-{
-    if(!BigInt_ensure_digits(target, source->num_digits)) {
-        return 0;
+// Allocates the header of a new BigInt from the registered allocator.  The
+// BigInt keeps using that allocator for its digits and for being freed.
+static BigInt* BigInt_alloc() {
+    const BigInt_allocator* allocator = BigInt_registered_allocator;
+    BigInt* big_int = allocator->alloc(allocator->context, sizeof(BigInt));
+    if(big_int) {
+        big_int->allocator = allocator;
     }
+    return big_int;
+}
 
-    memmove(target->digits, source->digits, source->num_digits * sizeof(unsigned char));
+static void BigInt_free_header(BigInt* big_int) {
+    big_int->allocator->free(big_int->allocator->context, big_int, sizeof(BigInt));
+}
 
-    target->is_negative = source->is_negative;
-    target->num_digits = source->num_digits;
+// Points big_int at storage for at least num_allocated_digits digits, using
+// the inline array when it is large enough.  big_int->allocator must be set.
+// returns non-zero on success or 0 on failure
+static BOOL BigInt_init_digits(BigInt* big_int, size_t num_allocated_digits) {
+    if(num_allocated_digits <= BIGINT_INLINE_DIGITS) {
+        big_int->digits = big_int->inline_digits;
+        big_int->num_allocated_digits = BIGINT_INLINE_DIGITS;
+        big_int->storage = BIGINT_STORAGE_INLINE;
+        return 1;
+    }
+    num_allocated_digits = BigInt_digits_capacity(num_allocated_digits);
+    big_int->digits = BigInt_alloc_digits(big_int->allocator, num_allocated_digits);
+    if(!big_int->digits) {
+        return 0;
+    }
+    big_int->num_allocated_digits = num_allocated_digits;
+    big_int->storage = BIGINT_STORAGE_HEAP;
     return 1;
 }
 
-BOOL BigInt_assign_int(BigInt* target, const int source) {
-    unsigned int value;
-    if(value < 0) {
-        target->is_negative = 1;
-        value = -source;
-    } else {
-        target->is_negative = 0;
-        value = source;
+// The start of a BigInt file.  The digits follow at BIGINT_FILE_HEADER
+// bytes; num_digits and is_negative are brought up to date when the BigInt
+// is synced or released.
+typedef struct BigInt_file_header {
+    char magic[8];
+    uint32_t repr; // BIGINT_REPR of the build that wrote the file
+    uint32_t digit_size; // sizeof(BigInt_digit) of that build
+    uint64_t num_digits;
+    uint32_t is_negative;
+} BigInt_file_header;
+
+#define BIGINT_FILE_HEADER 64
+#define BIGINT_FILE_MAGIC "BigInt\0\1"
+
+// Size a new BigInt file starts out at.
+#ifndef BIGINT_MAPPED_INITIAL_BYTES
+#define BIGINT_MAPPED_INITIAL_BYTES 4096
+#endif//BIGINT_MAPPED_INITIAL_BYTES
+
+#if BIGINT_MAPPED
+static BigInt_file_header* BigInt_file_header_of(const BigInt* big_int) {
+    return (BigInt_file_header*)((char*)big_int->digits - BIGINT_FILE_HEADER);
+}
+
+// Returns the size of a BigInt file holding num_digits digits, or 0 if that
+// doesn't fit in a size_t.
+static size_t BigInt_file_bytes(size_t num_digits) {
+    if(num_digits > (SIZE_MAX - BIGINT_FILE_HEADER) / sizeof(BigInt_digit)) {
+        return 0;
     }
+    return BIGINT_FILE_HEADER + num_digits * sizeof(BigInt_digit);
+}
 
-    target->num_digits = floor(log10(value)) + 1;
+// Records the sign and length of the mapped big_int in its file header.
+static void BigInt_write_file_header(const BigInt* big_int) {
+    BigInt_file_header* header = BigInt_file_header_of(big_int);
+    header->num_digits = big_int->num_digits;
+    header->is_negative = big_int->is_negative;
+}
 
-    // Special case for 0
-    if(target->num_digits == 0) {
-        target->num_digits = 1;
-    }
+// Shrinks the file fd back to bytes after growing it for a mapping that
+// failed, keeping errno from that failure.  Should this fail too, the file
+// just ends in unused zero digits.
+static void BigInt_restore_file_size(int fd, off_t bytes) {
+    int error = errno;
+    int truncated = ftruncate(fd, bytes);
+    (void)truncated;
+    errno = error;
+}
 
-    if(!BigInt_ensure_digits(target, target->num_digits)) {
+// Grows the file and mapping behind big_int to num_allocated_digits digits.
+// returns non-zero on success or 0 on failure
+static BOOL BigInt_remap_digits(BigInt* big_int, size_t num_allocated_digits) {
+    size_t old_bytes = BigInt_file_bytes(big_int->num_allocated_digits);
+    size_t new_bytes = BigInt_file_bytes(num_allocated_digits);
+    if(!new_bytes || (off_t)new_bytes < 0) {
+        errno = ENOMEM;
         return 0;
     }
-
-    unsigned int count = target->num_digits;
-    unsigned char* digits = target->digits;
-    while(count--) {
-        *(digits++) = value % 10;
-        value /= 10;
+    struct stat st;
+    if(fstat(big_int->mapped_fd, &st) || ftruncate(big_int->mapped_fd, (off_t)new_bytes)) {
+        return 0;
+    }
+    char* base = (char*)BigInt_file_header_of(big_int);
+#ifdef __linux__
+    char* new_base = mremap(base, old_bytes, new_bytes, MREMAP_MAYMOVE);
+#else
+    char* new_base = mmap(NULL, new_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, big_int->mapped_fd, 0);
+#endif
+    if(new_base == MAP_FAILED) {
+        BigInt_restore_file_size(big_int->mapped_fd, st.st_size);
+        return 0;
     }
+#ifndef __linux__
+    munmap(base, old_bytes);
+#endif
+    base = new_base;
+    big_int->digits = (BigInt_digit*)(base + BIGINT_FILE_HEADER);
+    big_int->num_allocated_digits = num_allocated_digits;
     return 1;
 }
 
-int BigInt_compare(const BigInt* a, const BigInt* b) {
-    // Quick return if one is negative and the other isn't
-    if(a->num_digits > 0 || a->digits[0] > 0 || b->num_digits > 0 || b->digits[0] > 0) {
-        if (a->is_negative && !b->is_negative) {
-            return -1;
-        } else if (!a->is_negative && b->is_negative) {
-            return 1;
-        }
+// Records the value of the mapped big_int in its file, then unmaps it and
+// closes the file.
+static void BigInt_unmap_digits(BigInt* big_int) {
+    BigInt_write_file_header(big_int);
+    munmap(BigInt_file_header_of(big_int), BigInt_file_bytes(big_int->num_allocated_digits));
+    close(big_int->mapped_fd);
+}
+#endif
+
+// Releases the digits of big_int if it holds a heap buffer or a mapping.
+static void BigInt_free_digits(BigInt* big_int) {
+    if(big_int->storage == BIGINT_STORAGE_HEAP) {
+        BigInt_release_digits(big_int->allocator, big_int->digits, big_int->num_allocated_digits);
     }
+#if BIGINT_MAPPED
+    if(big_int->storage == BIGINT_STORAGE_MAPPED) {
+        BigInt_unmap_digits(big_int);
+    }
+#endif
+}
 
-    return a->is_negative ? BigInt_compare_digits(b, a) : BigInt_compare_digits(a, b);
+// Returns non-zero if big_int's digits are a heap buffer other BigInts also
+// hold, so big_int must not write to them.
+static BOOL BigInt_digits_shared(const BigInt* big_int) {
+    return big_int->storage == BIGINT_STORAGE_HEAP
+        && atomic_load_explicit(&BigInt_digits_header_of(big_int->digits)->refs, memory_order_acquire) > 1;
 }
 
-int BigInt_compare_int(const BigInt* a, int b) {
-    int aa;
-    if(!BigInt_to_int(a, &aa)) {
-        // a is too big to fit into an integer:
-        return a->is_negative ? -1 : 1;
-    }
-    if(aa == b) {
-        return 0;
+// Points target, whose own digits must already have been released, at the
+// heap buffer of source.  The caller checks the allocators match.
+static void BigInt_share_digits(BigInt* target, const BigInt* source) {
+    assert(source->storage == BIGINT_STORAGE_HEAP && target->allocator == source->allocator);
+    atomic_fetch_add_explicit(&BigInt_digits_header_of(source->digits)->refs, 1, memory_order_relaxed);
+    target->digits = source->digits;
+    target->num_allocated_digits = source->num_allocated_digits;
+    target->storage = BIGINT_STORAGE_HEAP;
+    target->num_digits = source->num_digits;
+    target->is_negative = source->is_negative;
+}
+
+// Checks the redzones of big_int's digits when they come from the redzone
+// allocator; other storage has none.
+static BOOL okay_big_int(const BigInt* big_int) {
+    return big_int->storage != BIGINT_STORAGE_HEAP
+        || big_int->allocator != &BigInt_redzone_allocator
+        || BigInt_redzone_check(BigInt_digits_header_of(big_int->digits),
+            BigInt_digits_bytes(big_int->num_allocated_digits));
+}
+
+//============================================================================
+// Scratch arenas
+//============================================================================
+
+struct BigInt_arena_block {
+    struct BigInt_arena_block* next;
+    size_t size; // bytes available after the header
+};
+
+#define BIGINT_ARENA_ALIGN 16
+#define BIGINT_ARENA_HEADER \
+    ((sizeof(struct BigInt_arena_block) + BIGINT_ARENA_ALIGN - 1) & ~(size_t)(BIGINT_ARENA_ALIGN - 1))
+
+// Smallest block an arena allocates; later blocks double in size.
+#ifndef BIGINT_ARENA_BLOCK_SIZE
+#define BIGINT_ARENA_BLOCK_SIZE 4096
+#endif//BIGINT_ARENA_BLOCK_SIZE
+
+void BigInt_arena_init(BigInt_arena* arena) {
+    arena->head = NULL;
+    arena->current = NULL;
+    arena->used = 0;
+    arena->allocator = BigInt_registered_allocator;
+}
+
+void BigInt_arena_destroy(BigInt_arena* arena) {
+    struct BigInt_arena_block* block = arena->head;
+    while(block) {
+        struct BigInt_arena_block* next = block->next;
+        arena->allocator->free(arena->allocator->context, block, BIGINT_ARENA_HEADER + block->size);
+        block = next;
     }
-    return aa < b ? -1 : 1;
+    BigInt_arena_init(arena);
 }
 
-int BigInt_compare_digits(const BigInt* a, const BigInt* b) {
-    // Not looking at the sign here, comparing the digits only.
+BigInt_arena_mark BigInt_arena_save(const BigInt_arena* arena) {
+    BigInt_arena_mark mark = { arena->current, arena->used };
+    return mark;
+}
 
-    // Quick return if one number has more digits than the other
-    if(a->num_digits > b->num_digits) {
-       return 1;
-    } else if(a->num_digits < b->num_digits) {
-       return -1;
+void BigInt_arena_restore(BigInt_arena* arena, BigInt_arena_mark mark) {
+    arena->current = mark.block;
+    arena->used = mark.used;
+}
+
+void BigInt_arena_reset(BigInt_arena* arena) {
+    arena->current = NULL;
+    arena->used = 0;
+}
+
+// Returns size bytes from arena, or NULL on memory allocation failure.
+static void* BigInt_arena_alloc(BigInt_arena* arena, size_t size) {
+    if(size > SIZE_MAX - BIGINT_ARENA_HEADER - BIGINT_ARENA_ALIGN) {
+        errno = ENOMEM;
+        return NULL;
     }
+    size = (size + BIGINT_ARENA_ALIGN - 1) & ~(size_t)(BIGINT_ARENA_ALIGN - 1);
 
-    // Both have the same number of digits, so we actually have to loop through until we
-    // find one that doesn't match.
-    unsigned int count = a->num_digits;
-    const unsigned char* pa = &a->digits[count-1];
-    const unsigned char* pb = &b->digits[count-1];
-    while(count--) {
-        char da = *(pa--);
-        char db = *(pb--);
-        if(da > db) {
-            return 1;
-        } else if(da < db) {
-            return -1;
+    struct BigInt_arena_block* block = arena->current;
+    if(block && block->size - arena->used >= size) {
+        void* p = (unsigned char*)block + BIGINT_ARENA_HEADER + arena->used;
+        arena->used += size;
+        return p;
+    }
+
+    // move on to the next block that is large enough, or add one
+    struct BigInt_arena_block* next = block ? block->next : arena->head;
+    while(next && next->size < size) {
+        next = next->next;
+    }
+    if(!next) {
+        if(!arena->allocator) {
+            arena->allocator = BigInt_registered_allocator;
+        }
+        size_t block_size = size > BIGINT_ARENA_BLOCK_SIZE ? size : BIGINT_ARENA_BLOCK_SIZE;
+        if(block && block->size <= SIZE_MAX / 4 && block_size < block->size * 2) {
+            block_size = block->size * 2;
+        }
+        next = arena->allocator->alloc(arena->allocator->context, BIGINT_ARENA_HEADER + block_size);
+        if(!next) {
+            return NULL;
+        }
+        next->size = block_size;
+        if(block) {
+            next->next = block->next;
+            block->next = next;
+        } else {
+            next->next = arena->head;
+            arena->head = next;
         }
     }
+    arena->current = next;
+    arena->used = size;
+    return (unsigned char*)next + BIGINT_ARENA_HEADER;
+}
 
-    // All digits match; numbers are equal
-    return 0;
+static _Thread_local BigInt_arena BigInt_thread_arena;
+static _Thread_local BigInt_arena* BigInt_thread_scratch;
+
+#if BIGINT_PTHREADS
+// Threads that use their built-in arena or cache digits set this key,
+// whose destructor releases both when they exit.  Destructors only run for threads
+// that set the key, and run again if a destructor sets it anew.
+static pthread_key_t BigInt_thread_exit_key;
+static pthread_once_t BigInt_thread_exit_once = PTHREAD_ONCE_INIT;
+static BOOL BigInt_thread_exit_key_created;
+static _Thread_local BOOL BigInt_thread_exit_registered;
+
+static void BigInt_thread_exit(void* unused) {
+    (void)unused;
+    BigInt_thread_exit_registered = 0;
+    BigInt_arena_destroy(&BigInt_thread_arena);
+    BigInt_digit_cache_flush();
 }
 
-BOOL BigInt_add(BigInt* big_int, const BigInt* addend) {
-    if(big_int->is_negative == addend->is_negative) {
-        // Sign will never change in this case so just leave
-        // it as-is.
-        if(!BigInt_add_digits(big_int, addend)) {
-            return 0;
-        }
-    } else {
-        // Figure out the sign.  Need to do this before calculating the digits of
-        // the digits result because changing those in big_int will affect the result
-        // of the compare.
-        unsigned int result_is_negative = BigInt_compare_digits(big_int, addend) > 0 ?
-                big_int->is_negative : addend->is_negative;
+static void BigInt_thread_exit_create_key() {
+    BigInt_thread_exit_key_created = !pthread_key_create(&BigInt_thread_exit_key, BigInt_thread_exit);
+}
+#endif//BIGINT_PTHREADS
 
-        if(!BigInt_subtract_digits(big_int, addend)) {
-            return 0;
-        }
-        big_int->is_negative = result_is_negative;
+// Arranges for the calling thread's built-in arena and digit cache to be
+// released when it exits.
+static void BigInt_thread_exit_register() {
+#if BIGINT_PTHREADS
+    if(!BigInt_thread_exit_registered) {
+        pthread_once(&BigInt_thread_exit_once, BigInt_thread_exit_create_key);
+        BigInt_thread_exit_registered = BigInt_thread_exit_key_created
+            && !pthread_setspecific(BigInt_thread_exit_key, &BigInt_thread_arena);
     }
-    return 1;
+#endif
 }
 
-BOOL BigInt_add_int(BigInt* big_int, const int addend) {
-    BigInt* big_int_addend = BigInt_construct(addend);
-    if(!big_int_addend) {
-        return 0;
-    }
-    BOOL result = BigInt_add(big_int, big_int_addend);
-    BigInt_free(big_int_addend);
-    return result;
+void BigInt_set_scratch_arena(BigInt_arena* arena) {
+    BigInt_thread_scratch = arena;
 }
 
-BOOL BigInt_add_digits(BigInt* big_int, const BigInt* addend) {
-    unsigned int digits_needed = MAX(big_int->num_digits, addend->num_digits) + 1; // TODO FIXME: this can overflow...
-    if(!BigInt_ensure_digits(big_int, digits_needed)) {
-        return 0;
+BigInt_arena* BigInt_scratch_arena() {
+    if(BigInt_thread_scratch) {
+        return BigInt_thread_scratch;
     }
+    BigInt_thread_exit_register();
+    return &BigInt_thread_arena;
+}
 
-    int i;
-    int carry = 0;
-    for(i = 0; i < addend->num_digits || carry > 0; ++i) { // TODO FIXME: refactor to protect from integer overflow
-        // Append another digit if necessary
-        if(i == big_int->num_digits) {
-            ++big_int->num_digits;
-            big_int->digits[i] = 0;
-        }
 
-        unsigned int addend_digit = i < addend->num_digits ? addend->digits[i] : 0;
-        unsigned int total = big_int->digits[i] + addend_digit + carry;
-        big_int->digits[i] = total % 10;
-        carry = (total >= 10) ? 1 : 0;
+// Drops zero digits from the most significant end of big_int, always keeping
+// at least one digit.
+static void BigInt_trim(BigInt* big_int) {
+    while(big_int->num_digits > 1 && !big_int->digits[big_int->num_digits-1]) {
+        big_int->num_digits--;
     }
+}
+
+// Returns the number of digits needed to hold value.
+static unsigned int BigInt_count_digits(unsigned int value) {
+#if BIGINT_REPR == BIGINT_REPR_BINARY64 || BIGINT_REPR == BIGINT_REPR_BASE1E19
+    // a single digit holds any unsigned int
+    (void)value;
     return 1;
+#else
+    unsigned int count = 1;
+    while(value >= BIGINT_BASE) {
+        value /= BIGINT_BASE;
+        count++;
+    }
+    return count;
+#endif
 }
 
-BOOL BigInt_subtract(BigInt* big_int, const BigInt* to_subtract) {
-    // Figure out the sign.  Need to do this before calculating the digits of
-    // the digits result because changing those in big_int will affect the result
-    // of the compare.
-    unsigned int result_is_negative = BigInt_compare(big_int, to_subtract) >= 0 ? 0 : 1;
-    
-    // Calculate the digits
-    if(big_int->is_negative == to_subtract->is_negative) {
+// Writes value into the digits of big_int, which must have room for
+// BigInt_count_digits(value) of them, and sets num_digits.  Leaves the sign
+// alone.
+static void BigInt_store_unsigned(BigInt* big_int, unsigned int value) {
+    big_int->num_digits = BigInt_count_digits(value);
+
+    size_t count = big_int->num_digits;
+    BigInt_digit* digits = big_int->digits;
+    while(count--) {
+        (*digits++) = BIGINT_DIGIT_FROM_VALUE(value % BIGINT_BASE);
+        value /= BIGINT_BASE;
+    }
+}
+
+// Initializes the BigInt at big_int, which the caller owns, to value.  The
+// digits of any int fit in the inline array so this never allocates; the
+// registered allocator is only used if the value grows later.
+static void BigInt_init_int(BigInt* big_int, int value) {
+    unsigned int value2;
+    if(value < 0) {
+        big_int->is_negative = 1;
+        value2 = 0u - (unsigned int)value;
+    } else {
+        big_int->is_negative = 0;
+        value2 = value;
+    }
+
+    big_int->allocator = BigInt_registered_allocator;
+    big_int->storage = BIGINT_STORAGE_INLINE;
+    big_int->digits = big_int->inline_digits;
+    big_int->num_allocated_digits = BIGINT_INLINE_DIGITS;
+    assert(BigInt_count_digits(value2) <= BIGINT_INLINE_DIGITS);
+    BigInt_store_unsigned(big_int, value2);
+}
+
+// Initializes the caller-owned temporary big_int to zero with room for
+// num_allocated_digits digits taken from arena.  Release it with
+// BigInt_free_digits(); the arena space itself is reclaimed by restoring
+// the arena.  If it outgrows that space it moves to the heap like any other
+// BigInt.
+// returns non-zero on success or 0 on failure
+static BOOL BigInt_init_scratch(BigInt* big_int, BigInt_arena* arena, size_t num_allocated_digits) {
+    BigInt_init_int(big_int, 0);
+    if(num_allocated_digits <= BIGINT_INLINE_DIGITS) {
+        return 1;
+    }
+    if(num_allocated_digits > SIZE_MAX / sizeof(BigInt_digit)) {
+        errno = ENOMEM;
+        return 0;
+    }
+    BigInt_digit* digits = BigInt_arena_alloc(arena, num_allocated_digits * sizeof(BigInt_digit));
+    if(!digits) {
+        return 0;
+    }
+    digits[0] = 0;
+    big_int->digits = digits;
+    big_int->num_allocated_digits = num_allocated_digits;
+    big_int->storage = BIGINT_STORAGE_SCRATCH;
+    return 1;
+}
+
+// Returns non-zero if big_int may give up its current storage for a heap
+// buffer from allocator taken from another BigInt.  Scratch and
+// caller-provided storage must stay where they are, and a BigInt's header
+// and digits always come from the same allocator.
+static BOOL BigInt_can_adopt(const BigInt* big_int, const BigInt_allocator* allocator) {
+    return (big_int->storage == BIGINT_STORAGE_INLINE || big_int->storage == BIGINT_STORAGE_HEAP)
+        && big_int->allocator == allocator;
+}
+
+// Initializes the temporary result to zero with room for num_allocated_digits
+// digits, to be handed to target with BigInt_move() once it holds target's
+// new value.  If target can adopt a heap buffer the digits come from target's
+// allocator so the move is free; otherwise (or if target is NULL) they come
+// from arena and will be copied.
+// returns non-zero on success or 0 on failure
+static BOOL BigInt_init_result(BigInt* result, const BigInt* target,
+        BigInt_arena* arena, size_t num_allocated_digits) {
+    if(!target || !BigInt_can_adopt(target, target->allocator)) {
+        return BigInt_init_scratch(result, arena, num_allocated_digits);
+    }
+    BigInt_init_int(result, 0);
+    result->allocator = target->allocator;
+    if(!BigInt_init_digits(result, num_allocated_digits)) {
+        return 0;
+    }
+    result->digits[0] = 0;
+    return 1;
+}
+
+// Multiplies the num_digits digits at digits by the value multiplier and
+// adds the value addend, in place.  Both values are below BIGINT_BASE.
+// Returns the digit carried out of the most significant position.
+static BigInt_digit BigInt_digits_multiply_add(BigInt_digit* digits, size_t num_digits,
+        BigInt_digit multiplier, BigInt_digit addend) {
+    BigInt_double_digit carry = addend;
+    for(size_t i = 0; i < num_digits; ++i) {
+        BigInt_double_digit total = (BigInt_double_digit)BIGINT_DIGIT_VALUE(digits[i]) * multiplier + carry;
+        digits[i] = BIGINT_DIGIT_FROM_VALUE(total % BIGINT_BASE);
+        carry = total / BIGINT_BASE;
+    }
+    return BIGINT_DIGIT_FROM_VALUE(carry);
+}
+
+// Divides the num_digits digits at digits by the non-zero word divisor,
+// writing the quotient's num_digits digits to quotient, which may be digits
+// or NULL.  Each step divides a two-word value by the same divisor, so with
+// BIGINT_DIVIDE_BY_RECIPROCAL this multiplies by a reciprocal computed once
+// instead, as in Moller and Granlund, "Improved division by invariant
+// integers" (2011).
+// Returns the remainder.
+static BigInt_int_word BigInt_digits_divide_small(BigInt_digit* quotient, const BigInt_digit* digits,
+        size_t num_digits, BigInt_int_word divisor) {
+#if BIGINT_DIVIDE_BY_RECIPROCAL
+    // Normalize the divisor so its top bit is set; each two-word value below
+    // divisor * 2^BIGINT_INT_WORD_BITS is shifted to match.
+    unsigned int shift = 0;
+    while(!((divisor << shift) >> (BIGINT_INT_WORD_BITS - 1))) {
+        shift++;
+    }
+    BigInt_int_word d = divisor << shift;
+    // floor((2^(2 * BIGINT_INT_WORD_BITS) - 1) / d) - 2^BIGINT_INT_WORD_BITS
+    BigInt_int_word v = (BigInt_int_word)(((BigInt_int_product)(BigInt_int_word)~d << BIGINT_INT_WORD_BITS
+        | (BigInt_int_word)~(BigInt_int_word)0) / d);
+
+    BigInt_int_word remainder = 0;
+    while(num_digits--) {
+        BigInt_int_product n = ((BigInt_int_product)remainder * BIGINT_BASE + BIGINT_DIGIT_VALUE(digits[num_digits])) << shift;
+        BigInt_int_word n1 = (BigInt_int_word)(n >> BIGINT_INT_WORD_BITS);
+        BigInt_int_word n0 = (BigInt_int_word)n;
+
+        // the estimate is at most one off either way
+        BigInt_int_product estimate = (BigInt_int_product)v * n1
+            + ((BigInt_int_product)(n1 + 1) << BIGINT_INT_WORD_BITS | n0);
+        BigInt_int_word q = (BigInt_int_word)(estimate >> BIGINT_INT_WORD_BITS);
+        BigInt_int_word r = n0 - q * d;
+        if(r > (BigInt_int_word)estimate) {
+            q--;
+            r += d;
+        }
+        if(r >= d) {
+            q++;
+            r -= d;
+        }
+        if(quotient) {
+            quotient[num_digits] = BIGINT_DIGIT_FROM_VALUE(q);
+        }
+        remainder = r >> shift;
+    }
+    return remainder;
+#else
+    BigInt_int_word remainder = 0;
+    while(num_digits--) {
+        BigInt_int_product total = (BigInt_int_product)remainder * BIGINT_BASE + BIGINT_DIGIT_VALUE(digits[num_digits]);
+        if(quotient) {
+            quotient[num_digits] = BIGINT_DIGIT_FROM_VALUE(total / divisor);
+        }
+        remainder = total % divisor;
+    }
+    return remainder;
+#endif
+}
+
+// Returns the decimal digits of the magnitude of big_int grouped into chunks of
+// BIGINT_CHUNK_WIDTH digits, least significant chunk first.  Representations
+// whose base is a power of ten hand back the digits array itself; the others
+// convert into a new buffer which is returned in *allocated and must be
+// released with BigInt_free_chunks().  Returns NULL on memory allocation failure.
+static const BigInt_digit* BigInt_decimal_chunks(const BigInt* big_int,
+        size_t* num_chunks, BigInt_digit** allocated) {
+#if BIGINT_DECIMAL_WIDTH
+    *allocated = NULL;
+    *num_chunks = big_int->num_digits;
+    return big_int->digits;
+#else
+    // every limb contributes less than two chunks
+    const BigInt_allocator* allocator = BigInt_registered_allocator;
+    BigInt_digit* chunks = BigInt_alloc_digits(allocator, 2 * big_int->num_digits + 1);
+    BigInt_digit* scratch = BigInt_alloc_digits(allocator, big_int->num_digits);
+    if(!chunks || !scratch) {
+        if(chunks) {
+            BigInt_release_digits(allocator, chunks, 2 * big_int->num_digits + 1);
+        }
+        if(scratch) {
+            BigInt_release_digits(allocator, scratch, big_int->num_digits);
+        }
+        return NULL;
+    }
+    size_t count = big_int->num_digits;
+    memcpy(scratch, big_int->digits, count * sizeof(BigInt_digit));
+    size_t n = 0;
+    do {
+        chunks[n++] = BigInt_digits_divide_small(scratch, scratch, count, BIGINT_CHUNK_BASE);
+        while(count && !scratch[count-1]) {
+            count--;
+        }
+    } while(count);
+    BigInt_release_digits(allocator, scratch, big_int->num_digits);
+    *num_chunks = n;
+    *allocated = chunks;
+    return chunks;
+#endif
+}
+
+// Releases the buffer that BigInt_decimal_chunks() returned in *allocated.
+static void BigInt_free_chunks(const BigInt* big_int, BigInt_digit* allocated) {
+    if(allocated) {
+        BigInt_release_digits(BigInt_registered_allocator, allocated, 2 * big_int->num_digits + 1);
+    }
+}
+
+// Returns the number of decimal digits needed to print chunk (at least 1).
+static unsigned int BigInt_chunk_strlen(BigInt_digit chunk) {
+#if BIGINT_REPR == BIGINT_REPR_PACKED_BCD
+    return chunk >> 4 ? 2 : 1;
+#else
+    unsigned int len = 1;
+    while(chunk >= 10) {
+        chunk /= 10;
+        len++;
+    }
+    return len;
+#endif
+}
+
+// Writes the lowest width decimal digits of chunk to buf, zero padded.
+static void BigInt_format_chunk(char* buf, BigInt_digit chunk, unsigned int width) {
+#if BIGINT_REPR == BIGINT_REPR_PACKED_BCD
+    // one digit per nibble
+    if(width == 2) {
+        *buf++ = '0' + (chunk >> 4);
+    }
+    *buf = '0' + (chunk & 0xF);
+#else
+    while(width--) {
+        buf[width] = '0' + chunk % 10;
+        chunk /= 10;
+    }
+#endif
+}
+
+BigInt* BigInt_construct(int value) {
+
+    BigInt* new_big_int = BigInt_alloc();
+    if(!new_big_int) {
+        return NULL;
+    }
+    BigInt_init_int(new_big_int, value);
+    return new_big_int;
+}
+
+BigInt* BigInt_clone(const BigInt* big_int, size_t num_allocated_digits) {
+    if(num_allocated_digits < big_int->num_digits) {
+        num_allocated_digits = big_int->num_digits;
+    }
+    BigInt* new_big_int = BigInt_alloc();
+    if(!new_big_int) {
+        return NULL;
+    }
+    if(
+        big_int->storage == BIGINT_STORAGE_HEAP && big_int->num_digits > BIGINT_INLINE_DIGITS
+        && num_allocated_digits <= big_int->num_allocated_digits
+        && new_big_int->allocator == big_int->allocator
+    ) {
+        // copied on write
+        BigInt_share_digits(new_big_int, big_int);
+        return new_big_int;
+    }
+    if(!BigInt_init_digits(new_big_int, num_allocated_digits)) {
+        BigInt_free_header(new_big_int);
+        return NULL;
+    }
+    new_big_int->is_negative = big_int->is_negative;
+    new_big_int->num_digits = big_int->num_digits;
+    memmove(new_big_int->digits, big_int->digits, big_int->num_digits * sizeof(BigInt_digit));
+    assert(okay_big_int(new_big_int));
+    return new_big_int;
+}
+
+BigInt* BigInt_from_string(const char* str) {
+    BOOL is_negative = (*str == '-');
+    if(is_negative) {
+        str++;
+    }
+    while(*str == '0' && *str != 0) { // remove leading zeros
+        str++;
+    }
+    size_t num_chars = strlen( str );
+    for(size_t i = 0; i < num_chars; i++) {
+        if(str[i] < '0' || str[i] > '9'){
+            errno = EINVAL;
+            return NULL;
+        }
+    }
+#if BIGINT_DECIMAL_WIDTH
+    size_t num_digits = (num_chars + BIGINT_DECIMAL_WIDTH - 1) / BIGINT_DECIMAL_WIDTH;
+#else
+    // each chunk of BIGINT_CHUNK_WIDTH decimal digits adds at most one digit
+    size_t num_digits = num_chars / BIGINT_CHUNK_WIDTH + 1;
+#endif
+    if(!num_digits) {
+        num_digits = 1;
+    }
+    BigInt* new_big_int = BigInt_alloc();
+    if(!new_big_int){
+        return NULL;
+    }
+    new_big_int->is_negative = is_negative;
+    if(!BigInt_init_digits(new_big_int, num_digits)){
+        BigInt_free_header(new_big_int);
+        return NULL;
+    }
+    BigInt_digit* digits = new_big_int->digits;
+#if BIGINT_DECIMAL_WIDTH
+    // fill digits from the least significant end of the string
+    size_t end = num_chars;
+    for(size_t i = 0; i < num_digits; i++) {
+        size_t start = end > BIGINT_DECIMAL_WIDTH ? end - BIGINT_DECIMAL_WIDTH : 0;
+        BigInt_double_digit digit = 0;
+        for(size_t j = start; j < end; j++) {
+            digit = digit * 10 + (str[j] - '0');
+        }
+        digits[i] = BIGINT_DIGIT_FROM_VALUE(digit);
+        end = start;
+    }
+    new_big_int->num_digits = num_digits;
+#else
+    // fold in chunks of decimal digits from the most significant end
+    digits[0] = 0;
+    new_big_int->num_digits = 1;
+    unsigned int chunk_width = num_chars % BIGINT_CHUNK_WIDTH;
+    if(!chunk_width) {
+        chunk_width = BIGINT_CHUNK_WIDTH;
+    }
+    while(*str) {
+        BigInt_digit chunk = 0;
+        BigInt_digit multiplier = 1;
+        for(unsigned int j = 0; j < chunk_width; j++) {
+            chunk = chunk * 10 + (*str++ - '0');
+            multiplier *= 10;
+        }
+        BigInt_digit carry = BigInt_digits_multiply_add(digits, new_big_int->num_digits, multiplier, chunk);
+        if(carry) {
+            digits[new_big_int->num_digits++] = carry;
+        }
+        chunk_width = BIGINT_CHUNK_WIDTH;
+    }
+#endif
+    BigInt_trim(new_big_int);
+    if(new_big_int->num_digits == 1 && !digits[0]) {
+        new_big_int->is_negative = 0;
+    }
+    assert(okay_big_int(new_big_int));
+    return new_big_int;
+}
+
+void BigInt_free(BigInt* big_int) {
+    if(big_int) {
+        BigInt_free_digits(big_int);
+        BigInt_free_header(big_int);
+    }
+}
+
+void BigInt_init_with_buffer(BigInt* big_int, BigInt_digit* digits,
+        size_t num_allocated_digits, int policy) {
+    BigInt_init_int(big_int, 0);
+    if(digits && num_allocated_digits) {
+        big_int->digits = digits;
+        big_int->num_allocated_digits = num_allocated_digits;
+        big_int->storage = policy == BIGINT_BUFFER_MAY_SPILL ? BIGINT_STORAGE_BUFFER : BIGINT_STORAGE_FIXED_BUFFER;
+        digits[0] = 0;
+    } else if(policy != BIGINT_BUFFER_MAY_SPILL) {
+        big_int->storage = BIGINT_STORAGE_FIXED_BUFFER;
+    }
+}
+
+void BigInt_release(BigInt* big_int) {
+    BigInt_free_digits(big_int);
+    BigInt_init_with_buffer(big_int, NULL, 0, BIGINT_BUFFER_MAY_SPILL);
+}
+
+BOOL BigInt_map_file(BigInt* big_int, int fd) {
+#if BIGINT_MAPPED
+    struct stat st;
+    if(fstat(fd, &st)) {
+        return 0;
+    }
+    BOOL is_new = st.st_size == 0;
+    if(is_new) {
+        if(ftruncate(fd, BIGINT_MAPPED_INITIAL_BYTES)) {
+            return 0;
+        }
+        st.st_size = BIGINT_MAPPED_INITIAL_BYTES;
+    }
+    if(st.st_size < BIGINT_FILE_HEADER + (off_t)sizeof(BigInt_digit) || (uint64_t)st.st_size > SIZE_MAX) {
+        errno = EINVAL;
+        return 0;
+    }
+    // map whole digits only
+    size_t num_allocated_digits = ((size_t)st.st_size - BIGINT_FILE_HEADER) / sizeof(BigInt_digit);
+    size_t bytes = BigInt_file_bytes(num_allocated_digits);
+    char* base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(base == MAP_FAILED) {
+        if(is_new) {
+            BigInt_restore_file_size(fd, 0);
+        }
+        return 0;
+    }
+    BigInt_file_header* header = (BigInt_file_header*)base;
+    BigInt_digit* digits = (BigInt_digit*)(base + BIGINT_FILE_HEADER);
+    if(is_new) {
+        memset(header, 0, BIGINT_FILE_HEADER);
+        memcpy(header->magic, BIGINT_FILE_MAGIC, sizeof(header->magic));
+        header->repr = BIGINT_REPR;
+        header->digit_size = sizeof(BigInt_digit);
+        header->num_digits = 1;
+        digits[0] = 0;
+    } else if(
+        memcmp(header->magic, BIGINT_FILE_MAGIC, sizeof(header->magic))
+        || header->repr != BIGINT_REPR || header->digit_size != sizeof(BigInt_digit)
+        || header->num_digits < 1 || header->num_digits > num_allocated_digits
+        || header->is_negative > 1
+    ) {
+        munmap(base, bytes);
+        errno = EINVAL;
+        return 0;
+    }
+
+    BigInt_init_int(big_int, 0);
+    big_int->digits = digits;
+    big_int->num_digits = header->num_digits;
+    big_int->num_allocated_digits = num_allocated_digits;
+    big_int->is_negative = header->is_negative;
+    big_int->storage = BIGINT_STORAGE_MAPPED;
+    big_int->mapped_fd = fd;
+    return 1;
+#else
+    (void)big_int;
+    (void)fd;
+    errno = ENOSYS;
+    return 0;
+#endif
+}
+
+BigInt* BigInt_open_mapped(const char* path) {
+#if BIGINT_MAPPED
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if(fd < 0) {
+        return NULL;
+    }
+    BigInt* big_int = BigInt_alloc();
+    if(!big_int) {
+        close(fd);
+        return NULL;
+    }
+    if(!BigInt_map_file(big_int, fd)) {
+        int error = errno;
+        close(fd);
+        BigInt_free_header(big_int);
+        errno = error;
+        return NULL;
+    }
+    return big_int;
+#else
+    (void)path;
+    errno = ENOSYS;
+    return NULL;
+#endif
+}
+
+BOOL BigInt_sync_mapped(BigInt* big_int) {
+#if BIGINT_MAPPED
+    if(big_int->storage != BIGINT_STORAGE_MAPPED) {
+        errno = EINVAL;
+        return 0;
+    }
+    BigInt_write_file_header(big_int);
+    return !msync(BigInt_file_header_of(big_int), BigInt_file_bytes(big_int->num_allocated_digits), MS_SYNC);
+#else
+    (void)big_int;
+    errno = ENOSYS;
+    return 0;
+#endif
+}
+
+BOOL BigInt_assign(BigInt* target, const BigInt* source)
+{
+    if(target->digits == source->digits) {
+        target->num_digits = source->num_digits;
+        target->is_negative = source->is_negative;
+        return 1;
+    }
+    if(
+        source->storage == BIGINT_STORAGE_HEAP && source->num_digits > BIGINT_INLINE_DIGITS
+        && BigInt_can_adopt(target, source->allocator)
+    ) {
+        // copied on write
+        BigInt_free_digits(target);
+        BigInt_share_digits(target, source);
+        return 1;
+    }
+
+    if(!BigInt_ensure_digits(target, source->num_digits)) {
+        return 0;
+    }
+
+    memmove(target->digits, source->digits, source->num_digits * sizeof(BigInt_digit));
+
+    target->is_negative = source->is_negative;
+    target->num_digits = source->num_digits;
+    return 1;
+}
+
+BOOL BigInt_assign_int(BigInt* target, const int source) {
+    unsigned int value;
+    BOOL is_negative;
+    if(source < 0) {
+        is_negative = 1;
+        value = 0u - (unsigned int)source;
+    } else {
+        is_negative = 0;
+        value = source;
+    }
+
+    unsigned int num_digits = BigInt_count_digits(value);
+    if(!BigInt_ensure_digits(target, num_digits)) {
+        return 0;
+    }
+    target->is_negative = is_negative;
+    BigInt_store_unsigned(target, value);
+    return 1;
+}
+
+BOOL BigInt_move(BigInt* target, BigInt* source) {
+    if(target == source) {
+        return 1;
+    }
+    // values that fit inline are cheaper to copy than a buffer is to keep
+    if(source->storage == BIGINT_STORAGE_HEAP && BigInt_can_adopt(target, source->allocator)
+            && source->num_digits > BIGINT_INLINE_DIGITS) {
+        BigInt_free_digits(target);
+        target->digits = source->digits;
+        target->num_digits = source->num_digits;
+        target->num_allocated_digits = source->num_allocated_digits;
+        target->is_negative = source->is_negative;
+        target->storage = BIGINT_STORAGE_HEAP;
+
+        // source falls back to its inline storage
+        source->digits = source->inline_digits;
+        source->num_allocated_digits = BIGINT_INLINE_DIGITS;
+        source->storage = BIGINT_STORAGE_INLINE;
+    } else if(!BigInt_assign(target, source)) {
+        return 0;
+    } else if(source->storage == BIGINT_STORAGE_HEAP) {
+        // its buffer may now be shared with target
+        BigInt_free_digits(source);
+        source->digits = source->inline_digits;
+        source->num_allocated_digits = BIGINT_INLINE_DIGITS;
+        source->storage = BIGINT_STORAGE_INLINE;
+    }
+    source->digits[0] = 0;
+    source->num_digits = 1;
+    source->is_negative = 0;
+    return 1;
+}
+
+BOOL BigInt_swap(BigInt* a, BigInt* b) {
+    if(a == b) {
+        return 1;
+    }
+    if(BigInt_can_adopt(a, b->allocator) && BigInt_can_adopt(b, a->allocator)) {
+        BigInt temp = *a;
+        *a = *b;
+        *b = temp;
+        // inline digits were copied along with the rest of the struct
+        if(a->storage == BIGINT_STORAGE_INLINE) {
+            a->digits = a->inline_digits;
+        }
+        if(b->storage == BIGINT_STORAGE_INLINE) {
+            b->digits = b->inline_digits;
+        }
+        return 1;
+    }
+
+    // At least one is tied to its buffer; exchange the digits themselves.
+    BigInt* longer = a->num_digits >= b->num_digits ? a : b;
+    BigInt* shorter = longer == a ? b : a;
+    if(!BigInt_ensure_digits(shorter, longer->num_digits)
+        || !BigInt_ensure_digits(longer, longer->num_digits)) {
+        return 0;
+    }
+    size_t i;
+    for(i = 0; i < shorter->num_digits; i++) {
+        BigInt_digit digit = a->digits[i];
+        a->digits[i] = b->digits[i];
+        b->digits[i] = digit;
+    }
+    memcpy(&shorter->digits[i], &longer->digits[i], (longer->num_digits - i) * sizeof(BigInt_digit));
+
+    size_t num_digits = a->num_digits;
+    a->num_digits = b->num_digits;
+    b->num_digits = num_digits;
+    BOOL is_negative = a->is_negative;
+    a->is_negative = b->is_negative;
+    b->is_negative = is_negative;
+    return 1;
+}
+
+int BigInt_compare(const BigInt* a, const BigInt* b) {
+    // Quick return if one is negative and the other isn't
+    if(a->num_digits > 0 || a->digits[0] > 0 || b->num_digits > 0 || b->digits[0] > 0) {
+        if (a->is_negative && !b->is_negative) {
+            return -1;
+        } else if (!a->is_negative && b->is_negative) {
+            return 1;
+        }
+    }
+
+    return a->is_negative ? BigInt_compare_digits(b, a) : BigInt_compare_digits(a, b);
+}
+
+int BigInt_compare_int(const BigInt* a, int b) {
+    int aa;
+    if(!BigInt_to_int(a, &aa)) {
+        // a is too big to fit into an integer:
+        return a->is_negative ? -1 : 1;
+    }
+    if(aa == b) {
+        return 0;
+    }
+    return aa < b ? -1 : 1;
+}
+
+int BigInt_compare_digits(const BigInt* a, const BigInt* b) {
+    // Not looking at the sign here, comparing the digits only.
+
+    // Quick return if one number has more digits than the other
+    if(a->num_digits > b->num_digits) {
+       return 1;
+    } else if(a->num_digits < b->num_digits) {
+       return -1;
+    }
+
+    // Both have the same number of digits, so we actually have to loop through until we
+    // find one that doesn't match.
+    size_t count = a->num_digits;
+    const BigInt_digit* pa = &a->digits[count-1];
+    const BigInt_digit* pb = &b->digits[count-1];
+    while(count--) {
+        BigInt_digit da = *(pa--);
+        BigInt_digit db = *(pb--);
+        if(da > db) {
+            return 1;
+        } else if(da < db) {
+            return -1;
+        }
+    }
+
+    // All digits match; numbers are equal
+    return 0;
+}
+
+BOOL BigInt_add(BigInt* big_int, const BigInt* addend) {
+    if(big_int->is_negative == addend->is_negative) {
+        // Sign will never change in this case so just leave
+        // it as-is.
+        if(!BigInt_add_digits(big_int, addend)) {
+            return 0;
+        }
+    } else {
+        // Figure out the sign.  Need to do this before calculating the digits of
+        // the digits result because changing those in big_int will affect the result
+        // of the compare.
+        unsigned int result_is_negative = BigInt_compare_digits(big_int, addend) > 0 ?
+                big_int->is_negative : addend->is_negative;
+
+        if(!BigInt_subtract_digits(big_int, addend)) {
+            return 0;
+        }
+        big_int->is_negative = result_is_negative;
+    }
+    return 1;
+}
+
+// Adds magnitude, negated if is_negative, to big_int in place.  Same-signed
+// values are added with a carry that stops as soon as it dies out and
+// opposite-signed ones are subtracted with a borrow that does the same, so
+// e.g. incrementing a counter only touches the digits that change.  The
+// buffer grows only when a carry passes the top digit.
+static BOOL BigInt_add_small(BigInt* big_int, unsigned int magnitude, BOOL is_negative) {
+    if(!magnitude) {
+        return 1;
+    }
+    // take a private copy of shared digits, without growing
+    if(!BigInt_ensure_digits(big_int, big_int->num_digits)) {
+        return 0;
+    }
+    BigInt_digit* digits = big_int->digits;
+    size_t num_digits = big_int->num_digits;
+
+    // zero takes the sign of what is added to it
+    if(big_int->is_negative == is_negative || (num_digits == 1 && !digits[0])) {
+        // Find out how far the carry runs before writing anything, so that
+        // big_int is left as it was if it can't grow.
+        BigInt_int_product carry = magnitude;
+        size_t i;
+        for(i = 0; carry && i < num_digits; i++) {
+            carry = (BIGINT_DIGIT_VALUE(digits[i]) + carry) / BIGINT_BASE;
+        }
+        if(carry) {
+            // carry is below UINT_MAX once it has passed a digit
+            size_t digits_needed;
+            if(!check_add_size_size(num_digits, BigInt_count_digits((unsigned int)carry), &digits_needed)) {
+                errno = ENOMEM;
+                return 0;
+            }
+            if(!BigInt_ensure_digits(big_int, digits_needed)) {
+                return 0;
+            }
+            digits = big_int->digits;
+        }
+
+        carry = magnitude;
+        for(i = 0; carry && i < num_digits; i++) {
+            BigInt_int_product total = BIGINT_DIGIT_VALUE(digits[i]) + carry;
+            digits[i] = BIGINT_DIGIT_FROM_VALUE(total % BIGINT_BASE);
+            carry = total / BIGINT_BASE;
+        }
+        unsigned int high = (unsigned int)carry;
+        while(high) {
+            digits[big_int->num_digits++] = BIGINT_DIGIT_FROM_VALUE(high % BIGINT_BASE);
+            high /= BIGINT_BASE;
+        }
+        big_int->is_negative = is_negative;
+        return 1;
+    }
+
+    // Opposite signs: if |big_int| < magnitude the result is magnitude - |big_int|
+    // with the sign of what is added, which fits in an unsigned int.
+    if(num_digits <= BigInt_count_digits(UINT_MAX)) {
+        BigInt_int_product value = 0;
+        size_t i = num_digits;
+        while(i--) {
+            value = value * BIGINT_BASE + BIGINT_DIGIT_VALUE(digits[i]);
+        }
+        if(value < magnitude) {
+            unsigned int difference = magnitude - (unsigned int)value;
+            if(!BigInt_ensure_digits(big_int, BigInt_count_digits(difference))) {
+                return 0;
+            }
+            BigInt_store_unsigned(big_int, difference);
+            big_int->is_negative = is_negative;
+            return 1;
+        }
+    }
+
+    BigInt_int_product borrow = magnitude;
+    size_t i;
+    for(i = 0; borrow; i++) {
+        assert(i < num_digits);
+        BigInt_int_product digit = BIGINT_DIGIT_VALUE(digits[i]);
+        BigInt_int_product to_take = borrow % BIGINT_BASE;
+        borrow /= BIGINT_BASE;
+        if(digit < to_take) {
+            digit += BIGINT_BASE;
+            borrow++;
+        }
+        digit -= to_take;
+        digits[i] = BIGINT_DIGIT_FROM_VALUE(digit);
+    }
+    BigInt_trim(big_int);
+    if(big_int->num_digits == 1 && !digits[0]) {
+        big_int->is_negative = 0;
+    }
+    return 1;
+}
+
+BOOL BigInt_add_int(BigInt* big_int, const int addend) {
+    // 0u - keeps INT_MIN's magnitude out of signed overflow
+    return addend < 0 ? BigInt_add_small(big_int, 0u - (unsigned int)addend, 1)
+        : BigInt_add_small(big_int, (unsigned int)addend, 0);
+}
+
+BOOL BigInt_add_digits(BigInt* big_int, const BigInt* addend) {
+    size_t digits_needed;
+    if(!check_add_size_size(MAX(big_int->num_digits, addend->num_digits), 1, &digits_needed)) {
+        errno = ENOMEM;
+        return 0;
+    }
+    if(!BigInt_ensure_digits(big_int, digits_needed)) {
+        return 0;
+    }
+
+    size_t i;
+    int carry = 0;
+    for(i = 0; i < addend->num_digits || carry > 0; ++i) {
+        // Append another digit if necessary
+        if(i == big_int->num_digits) {
+            ++big_int->num_digits;
+            big_int->digits[i] = 0;
+        }
+
+        BigInt_digit addend_digit = i < addend->num_digits ? addend->digits[i] : 0;
+        big_int->digits[i] = BigInt_digit_add(big_int->digits[i], addend_digit, &carry);
+    }
+    return 1;
+}
+
+BOOL BigInt_subtract(BigInt* big_int, const BigInt* to_subtract) {
+    // Figure out the sign.  Need to do this before calculating the digits of
+    // the digits result because changing those in big_int will affect the result
+    // of the compare.
+    unsigned int result_is_negative = BigInt_compare(big_int, to_subtract) >= 0 ? 0 : 1;
+    
+    // Calculate the digits
+    if(big_int->is_negative == to_subtract->is_negative) {
         if(!BigInt_subtract_digits(big_int, to_subtract)) {
             return 0;
         }
     } else {
-        if(!BigInt_add_digits(big_int, to_subtract)) {
+        if(!BigInt_add_digits(big_int, to_subtract)) {
+            return 0;
+        }
+    }
+    
+    // Figure out the sign
+    big_int->is_negative = result_is_negative;
+    return 1;
+}
+
+
+BOOL BigInt_subtract_int(BigInt* big_int, const int to_subtract) {
+    return to_subtract < 0 ? BigInt_add_small(big_int, 0u - (unsigned int)to_subtract, 0)
+        : BigInt_add_small(big_int, (unsigned int)to_subtract, 1);
+}
+
+BOOL BigInt_subtract_digits(BigInt* big_int, const BigInt* to_subtract) {
+
+    size_t digits_needed;
+    if(!check_add_size_size(MAX(big_int->num_digits, to_subtract->num_digits), 1, &digits_needed)) {
+        errno = ENOMEM;
+        return 0;
+    }
+    if(!BigInt_ensure_digits(big_int, digits_needed)) {
+        return 0;
+    }
+
+    // Determine the larger int.  This will go on "top"
+    // of the subtraction.  Sign doesn't matter here since we've already
+    // determined the sign of the final result above.
+    const BigInt_digit* greater_int_digits;
+    const BigInt_digit* smaller_int_digits;
+    size_t smaller_int_num_digits;
+    size_t greater_int_num_digits;
+
+    if(BigInt_compare_digits(big_int, to_subtract) > 0) {
+        greater_int_digits = big_int->digits;
+        greater_int_num_digits = big_int->num_digits;
+        smaller_int_digits = to_subtract->digits;
+        smaller_int_num_digits = to_subtract->num_digits;
+    } else {
+        greater_int_digits = to_subtract->digits;
+        greater_int_num_digits = to_subtract->num_digits;
+        smaller_int_digits = big_int->digits;
+        smaller_int_num_digits = big_int->num_digits;
+    }
+
+    // Actually carry out the subtraction.
+    size_t i;
+    int carry = 0;
+    big_int->num_digits = 1;
+
+    for(i = 0; i < greater_int_num_digits; ++i) {
+        BigInt_digit smaller_digit = i < smaller_int_num_digits ? smaller_int_digits[i] : 0;
+        BigInt_digit new_digit = BigInt_digit_subtract(greater_int_digits[i], smaller_digit, &carry);
+        big_int->digits[i] = new_digit;
+        if(new_digit != 0) {
+            big_int->num_digits = i + 1;
+        }
+    }
+
+    assert(carry == 0);
+    return 1;
+}
+
+//============================================================================
+// Multiplication kernels
+//============================================================================
+
+// Default sizes, in digits of the shorter operand, from which
+// BigInt_multiply uses each faster algorithm (see BigInt_set_threshold).
+#ifndef BIGINT_KARATSUBA_THRESHOLD
+#define BIGINT_KARATSUBA_THRESHOLD 32
+#endif//BIGINT_KARATSUBA_THRESHOLD
+
+#ifndef BIGINT_TOOM3_THRESHOLD
+#define BIGINT_TOOM3_THRESHOLD 400
+#endif//BIGINT_TOOM3_THRESHOLD
+
+#ifndef BIGINT_TOOM4_THRESHOLD
+#define BIGINT_TOOM4_THRESHOLD 1000
+#endif//BIGINT_TOOM4_THRESHOLD
+
+// The transform packs several small digits into each coefficient, so it
+// pays off much sooner for the decimal representations.
+#ifndef BIGINT_NTT_THRESHOLD
+#if BIGINT_REPR == BIGINT_REPR_DECIMAL
+#define BIGINT_NTT_THRESHOLD 80
+#elif BIGINT_REPR == BIGINT_REPR_PACKED_BCD
+#define BIGINT_NTT_THRESHOLD 64
+#elif BIGINT_REPR == BIGINT_REPR_BASE1E9
+#define BIGINT_NTT_THRESHOLD 400
+#elif BIGINT_REPR == BIGINT_REPR_BASE1E19
+#define BIGINT_NTT_THRESHOLD 300
+#else
+#define BIGINT_NTT_THRESHOLD 700
+#endif
+#endif//BIGINT_NTT_THRESHOLD
+
+// in digits of the divisor and of the quotient (see BigInt_divide)
+#ifndef BIGINT_DIVIDE_THRESHOLD
+#define BIGINT_DIVIDE_THRESHOLD 40
+#endif//BIGINT_DIVIDE_THRESHOLD
+
+static const size_t BigInt_default_thresholds[BIGINT_THRESHOLD_COUNT] = {
+    BIGINT_KARATSUBA_THRESHOLD,
+    BIGINT_TOOM3_THRESHOLD,
+    BIGINT_TOOM4_THRESHOLD,
+    BIGINT_NTT_THRESHOLD,
+    BIGINT_DIVIDE_THRESHOLD,
+};
+
+// The smallest operands each algorithm can split into strictly smaller
+// products.  Toom-Cook's evaluated pieces are a couple of digits longer
+// than the pieces themselves.  Recursive division needs halves of at least
+// two digits for long division to take over.
+static const size_t BigInt_minimum_thresholds[BIGINT_THRESHOLD_COUNT] = {
+    2,
+    16,
+    16,
+    2,
+    4,
+};
+
+static size_t BigInt_thresholds[BIGINT_THRESHOLD_COUNT] = {
+    BIGINT_KARATSUBA_THRESHOLD,
+    BIGINT_TOOM3_THRESHOLD,
+    BIGINT_TOOM4_THRESHOLD,
+    BIGINT_NTT_THRESHOLD,
+    BIGINT_DIVIDE_THRESHOLD,
+};
+
+BOOL BigInt_set_threshold(int threshold, size_t num_digits) {
+    if(threshold < 0 || threshold >= BIGINT_THRESHOLD_COUNT) {
+        errno = EINVAL;
+        return 0;
+    }
+    if(!num_digits) {
+        num_digits = BigInt_default_thresholds[threshold];
+    }
+    BigInt_thresholds[threshold] = MAX(num_digits, BigInt_minimum_thresholds[threshold]);
+    return 1;
+}
+
+size_t BigInt_get_threshold(int threshold) {
+    if(threshold < 0 || threshold >= BIGINT_THRESHOLD_COUNT) {
+        errno = EINVAL;
+        return 0;
+    }
+    return BigInt_thresholds[threshold];
+}
+
+// Adds the product of the na digits at a and the nb digits at b to the
+// digits at acc, which must be long enough to absorb the final carry.
+static void BigInt_digits_multiply_accumulate(BigInt_digit* acc,
+        const BigInt_digit* a, size_t na, const BigInt_digit* b, size_t nb) {
+    for(size_t j = 0; j < nb; j++) {
+        BigInt_double_digit multiplier = BIGINT_DIGIT_VALUE(b[j]);
+        if(!multiplier) {
+            continue;
+        }
+        BigInt_double_digit carry = 0;
+        size_t i;
+        for(i = 0; i < na; i++) {
+            BigInt_double_digit total = (BigInt_double_digit)BIGINT_DIGIT_VALUE(a[i]) * multiplier
+                + BIGINT_DIGIT_VALUE(acc[i + j]) + carry;
+            acc[i + j] = BIGINT_DIGIT_FROM_VALUE(total % BIGINT_BASE);
+            carry = total / BIGINT_BASE;
+        }
+        for(i += j; carry; i++) {
+            BigInt_double_digit total = BIGINT_DIGIT_VALUE(acc[i]) + carry;
+            acc[i] = BIGINT_DIGIT_FROM_VALUE(total % BIGINT_BASE);
+            carry = total / BIGINT_BASE;
+        }
+    }
+}
+
+// A column sum of digit products for BigInt_digits_multiply_basecase, kept
+// in two parts, so the carries of a whole column are resolved at once
+// instead of after every product.
+#if BIGINT_REPR == BIGINT_REPR_BINARY64 || BIGINT_REPR == BIGINT_REPR_BASE1E19
+typedef struct BigInt_column {
+    unsigned __int128 low;
+    uint64_t high; // multiples of 2^128
+} BigInt_column;
+
+static inline void BigInt_column_add(BigInt_column* column, BigInt_digit a, BigInt_digit b) {
+    unsigned __int128 product = (unsigned __int128)a * b;
+    column->low += product;
+    column->high += column->low < product;
+}
+
+// Returns the column sum's lowest digit and divides the sum by BIGINT_BASE.
+static inline BigInt_digit BigInt_column_digit(BigInt_column* column) {
+#if BIGINT_REPR == BIGINT_REPR_BINARY64
+    BigInt_digit digit = (BigInt_digit)column->low;
+    column->low = (column->low >> 64) | ((unsigned __int128)column->high << 64);
+    column->high = 0;
+    return digit;
+#else
+    unsigned __int128 remainder = column->high % BIGINT_BASE;
+    column->high /= BIGINT_BASE;
+    // the rest in two 128 by 64 bit steps, each with a 64 bit quotient
+    unsigned __int128 dividend = (remainder << 64) | (uint64_t)(column->low >> 64);
+    uint64_t quotient_high = (uint64_t)(dividend / BIGINT_BASE);
+    dividend = ((dividend - (unsigned __int128)quotient_high * BIGINT_BASE) << 64) | (uint64_t)column->low;
+    uint64_t quotient_low = (uint64_t)(dividend / BIGINT_BASE);
+    column->low = ((unsigned __int128)quotient_high << 64) | quotient_low;
+    return (BigInt_digit)(dividend - (unsigned __int128)quotient_low * BIGINT_BASE);
+#endif
+}
+#else
+// Digit products are below 2^60 and BIGINT_BASE below 2^32, so dividing
+// needs no type wider than 64 bits.
+typedef struct BigInt_column {
+    uint64_t low;
+    uint64_t high; // multiples of 2^64
+} BigInt_column;
+
+static inline void BigInt_column_add(BigInt_column* column, BigInt_digit a, BigInt_digit b) {
+    uint64_t product = (uint64_t)BIGINT_DIGIT_VALUE(a) * BIGINT_DIGIT_VALUE(b);
+    column->low += product;
+    column->high += column->low < product;
+}
+
+// Returns the column sum's lowest digit and divides the sum by BIGINT_BASE.
+static inline BigInt_digit BigInt_column_digit(BigInt_column* column) {
+    uint64_t remainder;
+    if(!column->high) {
+        remainder = column->low % BIGINT_BASE;
+        column->low /= BIGINT_BASE;
+    } else {
+        // long division by half words
+        remainder = column->high % BIGINT_BASE;
+        column->high /= BIGINT_BASE;
+        uint64_t dividend = (remainder << 32) | (column->low >> 32);
+        uint64_t quotient_high = dividend / BIGINT_BASE;
+        remainder = dividend % BIGINT_BASE;
+        dividend = (remainder << 32) | (column->low & 0xFFFFFFFF);
+        column->low = (quotient_high << 32) | (dividend / BIGINT_BASE);
+        remainder = dividend % BIGINT_BASE;
+    }
+    return BIGINT_DIGIT_FROM_VALUE(remainder);
+}
+#endif
+
+// Doubles a column sum.
+static inline void BigInt_column_double(BigInt_column* column) {
+    column->high = (column->high << 1) | (uint64_t)(column->low >> (8 * sizeof(column->low) - 1));
+    column->low <<= 1;
+}
+
+// Adds the column sum addend to column.
+static inline void BigInt_column_add_column(BigInt_column* column, const BigInt_column* addend) {
+    column->low += addend->low;
+    column->high += addend->high + (column->low < addend->low);
+}
+
+// Sets the na + nb digits at out to the product of the na digits at a and
+// the nb digits at b by the pencil and paper method, one column of the
+// product at a time: each column's digit products are summed before
+// carrying, and every digit of out is written once.  out must not overlap
+// a or b.
+static void BigInt_digits_multiply_basecase(BigInt_digit* out,
+        const BigInt_digit* a, size_t na, const BigInt_digit* b, size_t nb) {
+    if(!na || !nb) {
+        memset(out, 0, (na + nb) * sizeof(BigInt_digit));
+        return;
+    }
+    BigInt_column column = {0, 0};
+    for(size_t k = 0; k < na + nb - 1; k++) {
+        size_t first = k >= nb ? k - nb + 1 : 0;
+        size_t last = k < na ? k : na - 1;
+        for(size_t i = first; i <= last; i++) {
+            BigInt_column_add(&column, a[i], b[k - i]);
+        }
+        out[k] = BigInt_column_digit(&column);
+    }
+    out[na + nb - 1] = BigInt_column_digit(&column);
+    assert(!column.low && !column.high);
+}
+
+// Sets the num_out digits at out to the lowest num_out digits of the
+// product of the na digits at a and the nb digits at b, where na and nb
+// aren't zero and num_out <= na + nb, like BigInt_digits_multiply_basecase
+// but without the columns above them.  out must not overlap a or b.
+static void BigInt_digits_multiply_low_basecase(BigInt_digit* out,
+        const BigInt_digit* a, size_t na, const BigInt_digit* b, size_t nb, size_t num_out) {
+    BigInt_column column = {0, 0};
+    for(size_t k = 0; k < num_out; k++) {
+        size_t first = k >= nb ? k - nb + 1 : 0;
+        size_t last = k < na ? k : na - 1;
+        for(size_t i = first; i <= last; i++) {
+            BigInt_column_add(&column, a[i], b[k - i]);
+        }
+        out[k] = BigInt_column_digit(&column);
+    }
+}
+
+// Sets the 2n digits at out to the square of the n digits at a, like
+// BigInt_digits_multiply_basecase but using that a[i] * a[j] and a[j] *
+// a[i] land in the same column: each such pair is multiplied once and the
+// column doubled, which about halves the digit products.
+static void BigInt_digits_square_basecase(BigInt_digit* out, const BigInt_digit* a, size_t n) {
+    if(!n) {
+        return;
+    }
+    BigInt_column carry = {0, 0};
+    for(size_t k = 0; k < 2 * n - 1; k++) {
+        BigInt_column column = {0, 0};
+        for(size_t i = k >= n ? k - n + 1 : 0; i < k - i; i++) {
+            BigInt_column_add(&column, a[i], a[k - i]);
+        }
+        BigInt_column_double(&column);
+        if(k % 2 == 0) {
+            BigInt_column_add(&column, a[k / 2], a[k / 2]);
+        }
+        BigInt_column_add_column(&column, &carry);
+        out[k] = BigInt_column_digit(&column);
+        carry = column;
+    }
+    out[2 * n - 1] = BigInt_column_digit(&carry);
+    assert(!carry.low && !carry.high);
+}
+
+// Sets the na digits at out to the na digits at a plus the nb digits at b,
+// where na >= nb, and returns the carry out of the top digit.  out may be a.
+static int BigInt_digits_add(BigInt_digit* out, const BigInt_digit* a, size_t na,
+        const BigInt_digit* b, size_t nb) {
+    int carry = 0;
+    size_t i;
+    for(i = 0; i < nb; i++) {
+        out[i] = BigInt_digit_add(a[i], b[i], &carry);
+    }
+    for(; i < na; i++) {
+        out[i] = BigInt_digit_add(a[i], 0, &carry);
+    }
+    return carry;
+}
+
+// Adds the nb digits at b to the na digits at a in place.  The sum must fit
+// in na digits; leading zeros of b beyond that are ignored.
+static void BigInt_digits_add_in_place(BigInt_digit* a, size_t na, const BigInt_digit* b, size_t nb) {
+    while(nb > na && !b[nb - 1]) {
+        nb--;
+    }
+    assert(nb <= na);
+    int carry = 0;
+    size_t i;
+    for(i = 0; i < nb; i++) {
+        a[i] = BigInt_digit_add(a[i], b[i], &carry);
+    }
+    for(; carry && i < na; i++) {
+        a[i] = BigInt_digit_add(a[i], 0, &carry);
+    }
+    assert(!carry);
+}
+
+// Sets the na digits at out to the na digits at a minus the nb digits at b,
+// where na >= nb, and returns the borrow out of the top digit.  out may be
+// a or b.
+static int BigInt_digits_subtract(BigInt_digit* out, const BigInt_digit* a, size_t na,
+        const BigInt_digit* b, size_t nb) {
+    int borrow = 0;
+    size_t i;
+    for(i = 0; i < nb; i++) {
+        out[i] = BigInt_digit_subtract(a[i], b[i], &borrow);
+    }
+    for(; i < na; i++) {
+        out[i] = BigInt_digit_subtract(a[i], 0, &borrow);
+    }
+    return borrow;
+}
+
+// Compares the na digits at a with the nb digits at b, neither of which
+// has leading zeros unless na == nb.
+// returns -1 if a < b, 0 if a == b, 1 if a > b
+static int BigInt_digits_compare(const BigInt_digit* a, size_t na, const BigInt_digit* b, size_t nb) {
+    if(na != nb) {
+        return na < nb ? -1 : 1;
+    }
+    while(na--) {
+        if(a[na] != b[na]) {
+            return a[na] < b[na] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// Returns the number of digits in the n digits at a without leading zeros.
+static size_t BigInt_digits_trim(const BigInt_digit* a, size_t n) {
+    while(n && !a[n - 1]) {
+        n--;
+    }
+    return n;
+}
+
+// Subtracts the nb digits at b from the na digits at a in place, where
+// na >= nb and the difference isn't negative.
+static void BigInt_digits_subtract_in_place(BigInt_digit* a, size_t na, const BigInt_digit* b, size_t nb) {
+    assert(na >= nb);
+    int borrow = 0;
+    size_t i;
+    for(i = 0; i < nb; i++) {
+        a[i] = BigInt_digit_subtract(a[i], b[i], &borrow);
+    }
+    for(; borrow && i < na; i++) {
+        a[i] = BigInt_digit_subtract(a[i], 0, &borrow);
+    }
+    assert(!borrow);
+}
+
+static BOOL BigInt_digits_multiply(BigInt_digit* out, const BigInt_digit* a, size_t na,
+        const BigInt_digit* b, size_t nb, BigInt_arena* arena);
+
+// Multiplies a long operand by one at most half its length as a series of
+// nb x nb products, so each of them can use the faster algorithms.
+static BOOL BigInt_digits_multiply_unbalanced(BigInt_digit* out, const BigInt_digit* a, size_t na,
+        const BigInt_digit* b, size_t nb, BigInt_arena* arena) {
+    BigInt_arena_mark mark = BigInt_arena_save(arena);
+    BigInt_digit* piece = BigInt_arena_alloc(arena, 2 * nb * sizeof(BigInt_digit));
+    if(!piece) {
+        return 0;
+    }
+    memset(out, 0, (na + nb) * sizeof(BigInt_digit));
+    for(size_t start = 0; start < na; start += nb) {
+        size_t len = na - start < nb ? na - start : nb;
+        if(!BigInt_digits_multiply(piece, &a[start], len, b, nb, arena)) {
+            BigInt_arena_restore(arena, mark);
+            return 0;
+        }
+        BigInt_digits_add_in_place(&out[start], na + nb - start, piece, len + nb);
+    }
+    BigInt_arena_restore(arena, mark);
+    return 1;
+}
+
+// Karatsuba's method.  With a = a1 * BASE^m + a0 and b = b1 * BASE^m + b0,
+//   a * b = z2 * BASE^2m + (z1 - z2 - z0) * BASE^m + z0
+// where z0 = a0 * b0, z2 = a1 * b1 and z1 = (a0 + a1) * (b0 + b1): three
+// half-size products instead of four.  Requires nb <= na < 2 * nb.
+static BOOL BigInt_digits_multiply_karatsuba(BigInt_digit* out, const BigInt_digit* a, size_t na,
+        const BigInt_digit* b, size_t nb, BigInt_arena* arena) {
+    size_t m = na / 2;
+    size_t ha = na - m; // a1 is the longer half
+    size_t hb = MAX(m, nb - m);
+    size_t nz = ha + hb + 1;
+
+    // a square needs only the one sum, and then its products are squares
+    // too (see BigInt_digits_multiply)
+    BOOL square = a == b && na == nb;
+
+    BigInt_arena_mark mark = BigInt_arena_save(arena);
+    BigInt_digit* sa = BigInt_arena_alloc(arena, ha * sizeof(BigInt_digit));
+    BigInt_digit* sb = square ? sa : BigInt_arena_alloc(arena, hb * sizeof(BigInt_digit));
+    BigInt_digit* z1 = BigInt_arena_alloc(arena, nz * sizeof(BigInt_digit));
+    if(!sa || !sb || !z1) {
+        BigInt_arena_restore(arena, mark);
+        return 0;
+    }
+    int carry_a = BigInt_digits_add(sa, &a[m], ha, a, m);
+    int carry_b = square ? carry_a
+        : nb - m >= m ? BigInt_digits_add(sb, &b[m], nb - m, b, m)
+        : BigInt_digits_add(sb, b, m, &b[m], nb - m);
+
+    // z0 and z2 go straight to their places in out
+    if(
+        !BigInt_digits_multiply(out, a, m, b, m, arena)
+        || !BigInt_digits_multiply(&out[2 * m], &a[m], ha, &b[m], nb - m, arena)
+        || !BigInt_digits_multiply(z1, sa, ha, sb, hb, arena)
+    ) {
+        BigInt_arena_restore(arena, mark);
+        return 0;
+    }
+
+    // The sums' carries are left out of the recursive product so that it is
+    // always smaller than this one; add their cross terms back in.
+    z1[nz - 1] = 0;
+    if(carry_a) {
+        BigInt_digits_add_in_place(&z1[ha], nz - ha, sb, hb);
+    }
+    if(carry_b) {
+        BigInt_digits_add_in_place(&z1[hb], nz - hb, sa, ha);
+    }
+    if(carry_a && carry_b) {
+        BigInt_digit one = BIGINT_DIGIT_FROM_VALUE(1);
+        BigInt_digits_add_in_place(&z1[nz - 1], 1, &one, 1);
+    }
+
+    BigInt_digits_subtract_in_place(z1, nz, out, 2 * m);
+    BigInt_digits_subtract_in_place(z1, nz, &out[2 * m], na + nb - 2 * m);
+    BigInt_digits_add_in_place(&out[m], na + nb - m, z1, nz);
+
+    BigInt_arena_restore(arena, mark);
+    return 1;
+}
+
+// A signed value in Toom-Cook's evaluation and interpolation: the
+// evaluated pieces and products at negative points can be negative.
+typedef struct BigInt_toom_value {
+    BigInt_digit* digits; // room for the caller's worst case
+    size_t num_digits;    // without leading zeros
+    BOOL is_negative;
+} BigInt_toom_value;
+
+// value += (y_is_negative ? -y : y) for the ny digits at y, which has no
+// leading zeros and doesn't overlap value.
+static void BigInt_toom_add(BigInt_toom_value* value, const BigInt_digit* y, size_t ny, BOOL y_is_negative) {
+    size_t n = value->num_digits;
+    if(value->is_negative == y_is_negative) {
+        int carry = n >= ny
+            ? BigInt_digits_add(value->digits, value->digits, n, y, ny)
+            : BigInt_digits_add(value->digits, y, ny, value->digits, n);
+        value->digits[MAX(n, ny)] = BIGINT_DIGIT_FROM_VALUE(carry);
+        value->num_digits = BigInt_digits_trim(value->digits, MAX(n, ny) + 1);
+    } else if(BigInt_digits_compare(value->digits, n, y, ny) >= 0) {
+        BigInt_digits_subtract(value->digits, value->digits, n, y, ny);
+        value->num_digits = BigInt_digits_trim(value->digits, n);
+    } else {
+        BigInt_digits_subtract(value->digits, y, ny, value->digits, n);
+        value->num_digits = BigInt_digits_trim(value->digits, ny);
+        value->is_negative = y_is_negative;
+    }
+    if(!value->num_digits) {
+        value->is_negative = 0;
+    }
+}
+
+// value *= multiplier, with room for the product
+static void BigInt_toom_multiply_small(BigInt_toom_value* value, unsigned int multiplier) {
+    if(multiplier <= 1) {
+        if(!multiplier) {
+            value->num_digits = 0;
+            value->is_negative = 0;
+        }
+        return;
+    }
+    BigInt_double_digit carry = 0;
+    for(size_t i = 0; i < value->num_digits; i++) {
+        BigInt_double_digit total = (BigInt_double_digit)BIGINT_DIGIT_VALUE(value->digits[i]) * multiplier + carry;
+        value->digits[i] = BIGINT_DIGIT_FROM_VALUE(total % BIGINT_BASE);
+        carry = total / BIGINT_BASE;
+    }
+    while(carry) {
+        value->digits[value->num_digits++] = BIGINT_DIGIT_FROM_VALUE(carry % BIGINT_BASE);
+        carry /= BIGINT_BASE;
+    }
+    value->num_digits = BigInt_digits_trim(value->digits, value->num_digits);
+    if(!value->num_digits) {
+        value->is_negative = 0;
+    }
+}
+
+// value /= divisor, where divisor is known to divide value exactly.
+static void BigInt_toom_divide_exact(BigInt_toom_value* value, int divisor) {
+    if(divisor < 0) {
+        divisor = -divisor;
+        value->is_negative = value->num_digits && !value->is_negative;
+    }
+    if(divisor == 1) {
+        return;
+    }
+    BigInt_double_digit remainder = 0;
+    for(size_t i = value->num_digits; i-- > 0;) {
+        BigInt_double_digit total = remainder * BIGINT_BASE + BIGINT_DIGIT_VALUE(value->digits[i]);
+        value->digits[i] = BIGINT_DIGIT_FROM_VALUE(total / (unsigned int)divisor);
+        remainder = total % (unsigned int)divisor;
+    }
+    assert(remainder == 0);
+    value->num_digits = BigInt_digits_trim(value->digits, value->num_digits);
+}
+
+// Points where Toom-Cook evaluates its operands, besides infinity.
+static const int BigInt_toom_points[] = {0, 1, -1, 2, -2, 3};
+
+// Sets value to the polynomial whose coefficients are the k pieces of the
+// n digits at x, each m digits long, evaluated at point.
+static void BigInt_toom_evaluate(BigInt_toom_value* value, const BigInt_digit* x, size_t n,
+        size_t m, unsigned int k, int point) {
+    value->num_digits = 0;
+    value->is_negative = 0;
+    for(unsigned int j = k; j-- > 0;) {
+        // Horner's rule, from the most significant piece down
+        BigInt_toom_multiply_small(value, point < 0 ? -point : point);
+        if(point < 0) {
+            value->is_negative = value->num_digits && !value->is_negative;
+        }
+        size_t start = j * m;
+        if(start < n) {
+            size_t len = BigInt_digits_trim(&x[start], MIN(m, n - start));
+            BigInt_toom_add(value, &x[start], len, 0);
+        }
+    }
+}
+
+// Toom-Cook k-way multiplication for k = 3 or 4.  Each operand is cut into
+// k pieces of m digits, read as the coefficients of a polynomial in
+// BASE^m.  The product polynomial has 2k - 1 coefficients, found from its
+// values at 2k - 1 points: 2k - 1 products of pieces instead of k^2.
+//
+// With infinity as one of the points, the product's top coefficient is
+// the product of the top pieces.  The remaining 2k - 2 coefficients are
+// interpolated from the finite points by Newton's divided differences,
+// each of which is an exact division by a difference of two points, and
+// then expanded back into powers of BASE^m.  Requires nb <= na < 2 * nb.
+static BOOL BigInt_digits_multiply_toom(BigInt_digit* out, const BigInt_digit* a, size_t na,
+        const BigInt_digit* b, size_t nb, unsigned int k, BigInt_arena* arena) {
+    size_t m = (na + k - 1) / k;
+    size_t n = 2 * k - 2; // finite points
+    // Evaluated pieces grow by less than two digits (at most 40 times a
+    // piece, at point 3), and interpolation's intermediate values by less
+    // than ten (in base 10).  BigInt_toom_add needs room for a carry digit
+    // on top.
+    size_t eval_digits = m + 3;
+    size_t work_digits = 2 * m + 12;
+
+    BigInt_arena_mark mark = BigInt_arena_save(arena);
+    BigInt_digit* buffer = BigInt_arena_alloc(arena,
+        (2 * eval_digits + (2 * n + 1) * work_digits) * sizeof(BigInt_digit));
+    if(!buffer) {
+        return 0;
+    }
+    BigInt_toom_value ea = {buffer, 0, 0};
+    BigInt_toom_value eb = {&buffer[eval_digits], 0, 0};
+    BigInt_toom_value values[6];
+    BigInt_toom_value coefficients[6];
+    BigInt_digit* top = &buffer[2 * eval_digits + 2 * n * work_digits];
+    for(size_t i = 0; i < n; i++) {
+        values[i].digits = &buffer[2 * eval_digits + i * work_digits];
+        coefficients[i].digits = &buffer[2 * eval_digits + (n + i) * work_digits];
+    }
+
+    // the top coefficient: the product of the top pieces
+    const BigInt_digit* piece_a = &a[(k - 1) * m];
+    const BigInt_digit* piece_b = (k - 1) * m < nb ? &b[(k - 1) * m] : b;
+    size_t top_a = BigInt_digits_trim(piece_a, na - (k - 1) * m);
+    size_t top_b = (k - 1) * m < nb ? BigInt_digits_trim(piece_b, nb - (k - 1) * m) : 0;
+    if(!BigInt_digits_multiply(top, piece_a, top_a, piece_b, top_b, arena)) {
+        BigInt_arena_restore(arena, mark);
+        return 0;
+    }
+    size_t top_digits = BigInt_digits_trim(top, top_a + top_b);
+
+    // the product at each finite point, less the top coefficient's share
+    // a square evaluates its operand once and squares the values
+    BOOL square = a == b && na == nb;
+    for(size_t i = 0; i < n; i++) {
+        int point = BigInt_toom_points[i];
+        BigInt_toom_evaluate(&ea, a, na, m, k, point);
+        if(square) {
+            eb = ea;
+        } else {
+            BigInt_toom_evaluate(&eb, b, nb, m, k, point);
+        }
+        BigInt_toom_value* value = &values[i];
+        if(!BigInt_digits_multiply(value->digits, ea.digits, ea.num_digits, eb.digits, eb.num_digits, arena)) {
+            BigInt_arena_restore(arena, mark);
+            return 0;
+        }
+        value->num_digits = BigInt_digits_trim(value->digits, ea.num_digits + eb.num_digits);
+        value->is_negative = value->num_digits && ea.is_negative != eb.is_negative;
+
+        BigInt_toom_value share = {coefficients[0].digits, top_digits, 0};
+        memcpy(share.digits, top, top_digits * sizeof(BigInt_digit));
+        for(size_t j = 0; j < n; j++) {
+            BigInt_toom_multiply_small(&share, point < 0 ? -point : point);
+        }
+        BigInt_toom_add(value, share.digits, share.num_digits, 1);
+    }
+
+    // divided differences: values[i] becomes the coefficient of
+    // (x - p0)(x - p1)...(x - p(i-1)) in Newton's form
+    for(size_t j = 1; j < n; j++) {
+        for(size_t i = n - 1; i >= j; i--) {
+            BigInt_toom_value* value = &values[i];
+            BigInt_toom_add(value, values[i - 1].digits, values[i - 1].num_digits, !values[i - 1].is_negative);
+            BigInt_toom_divide_exact(value, BigInt_toom_points[i] - BigInt_toom_points[i - j]);
+        }
+    }
+
+    // expand Newton's form into powers of x, innermost factor first
+    BigInt_toom_value* c = coefficients;
+    memcpy(c[0].digits, values[n - 1].digits, values[n - 1].num_digits * sizeof(BigInt_digit));
+    c[0].num_digits = values[n - 1].num_digits;
+    c[0].is_negative = values[n - 1].is_negative;
+    for(size_t j = n - 1; j-- > 0;) {
+        // c = c * (x - p(j)) + values[j]
+        int point = BigInt_toom_points[j];
+        size_t degree = n - 2 - j;
+        memcpy(c[degree + 1].digits, c[degree].digits, c[degree].num_digits * sizeof(BigInt_digit));
+        c[degree + 1].num_digits = c[degree].num_digits;
+        c[degree + 1].is_negative = c[degree].is_negative;
+        for(size_t i = degree + 1; i-- > 0;) {
+            BigInt_toom_multiply_small(&c[i], point < 0 ? -point : point);
+            if(point > 0) {
+                c[i].is_negative = c[i].num_digits && !c[i].is_negative;
+            }
+            if(i > 0) {
+                BigInt_toom_add(&c[i], c[i - 1].digits, c[i - 1].num_digits, c[i - 1].is_negative);
+            }
+        }
+        BigInt_toom_add(&c[0], values[j].digits, values[j].num_digits, values[j].is_negative);
+    }
+
+    // out = sum of c[i] * BASE^(i * m), all of which are non-negative
+    memset(out, 0, (na + nb) * sizeof(BigInt_digit));
+    for(size_t i = 0; i <= n; i++) {
+        const BigInt_digit* digits = i < n ? c[i].digits : top;
+        size_t num_digits = i < n ? c[i].num_digits : top_digits;
+        assert(i == n || !c[i].is_negative);
+        if(i * m < na + nb) {
+            BigInt_digits_add_in_place(&out[i * m], na + nb - i * m, digits, num_digits);
+        } else {
+            assert(!num_digits);
+        }
+    }
+
+    BigInt_arena_restore(arena, mark);
+    return 1;
+}
+
+#if BIGINT_NTT
+// Number theoretic transform.  The operands' digits are grouped into
+// coefficients below 2^64 and their convolution is computed modulo three
+// primes just under 2^62 by fast transforms over the integers mod p.  The
+// product's coefficients are below 2^184, the product of the primes, so
+// the Chinese remainder theorem recovers them exactly.
+
+// digits per coefficient, as many as fit below 2^64, and the base of the
+// coefficients (2^64 itself for BIGINT_REPR_BINARY64)
+#if BIGINT_REPR == BIGINT_REPR_DECIMAL
+#define BIGINT_NTT_GROUP 19
+#define BIGINT_NTT_CHUNK_BASE 10000000000000000000ull
+#elif BIGINT_REPR == BIGINT_REPR_PACKED_BCD
+#define BIGINT_NTT_GROUP 9
+#define BIGINT_NTT_CHUNK_BASE 1000000000000000000ull
+#elif BIGINT_REPR == BIGINT_REPR_BASE1E9
+#define BIGINT_NTT_GROUP 2
+#define BIGINT_NTT_CHUNK_BASE 1000000000000000000ull
+#elif BIGINT_REPR == BIGINT_REPR_BASE1E19
+#define BIGINT_NTT_GROUP 1
+#define BIGINT_NTT_CHUNK_BASE BIGINT_BASE
+#else
+#define BIGINT_NTT_GROUP 1
+#endif
+
+// Primes c * 2^k + 1 with a generator of their multiplicative group.
+// Transforms are at most 2^55 long, the smallest k.
+static const uint64_t BigInt_ntt_primes[3][2] = {
+    {4179340454199820289ull, 3}, // 29 * 2^57 + 1
+    {2485986994308513793ull, 5}, // 69 * 2^55 + 1
+    {1945555039024054273ull, 5}, // 27 * 2^56 + 1
+};
+#define BIGINT_NTT_MAX_LOG 55
+
+// Arithmetic mod p on values in [0, p).  Products use Montgomery's
+// representation x * 2^64 mod p, which reduces without dividing.
+typedef struct BigInt_ntt_modulus {
+    uint64_t p;
+    uint64_t p_inv; // -1 / p mod 2^64
+    uint64_t r2;    // 2^128 mod p, to convert into Montgomery's form
+} BigInt_ntt_modulus;
+
+static void BigInt_ntt_modulus_init(BigInt_ntt_modulus* modulus, uint64_t p) {
+    uint64_t inverse = p; // correct to 3 bits; each step doubles that
+    for(int i = 0; i < 5; i++) {
+        inverse *= 2 - p * inverse;
+    }
+    modulus->p = p;
+    modulus->p_inv = 0 - inverse;
+    uint64_t r = (0 - p) % p;
+    modulus->r2 = (uint64_t)((unsigned __int128)r * r % p);
+}
+
+static inline uint64_t BigInt_ntt_multiply(uint64_t a, uint64_t b, const BigInt_ntt_modulus* modulus) {
+    unsigned __int128 t = (unsigned __int128)a * b;
+    uint64_t m = (uint64_t)t * modulus->p_inv;
+    uint64_t u = (uint64_t)((t + (unsigned __int128)m * modulus->p) >> 64);
+    return u >= modulus->p ? u - modulus->p : u;
+}
+
+static inline uint64_t BigInt_ntt_add(uint64_t a, uint64_t b, uint64_t p) {
+    uint64_t sum = a + b;
+    return sum >= p ? sum - p : sum;
+}
+
+static inline uint64_t BigInt_ntt_subtract(uint64_t a, uint64_t b, uint64_t p) {
+    return a >= b ? a - b : a + p - b;
+}
+
+// Returns base^exponent mod p, all in Montgomery's form.
+static uint64_t BigInt_ntt_power(uint64_t base, uint64_t exponent, const BigInt_ntt_modulus* modulus) {
+    uint64_t result = BigInt_ntt_multiply(1, modulus->r2, modulus);
+    while(exponent) {
+        if(exponent & 1) {
+            result = BigInt_ntt_multiply(result, base, modulus);
+        }
+        base = BigInt_ntt_multiply(base, base, modulus);
+        exponent >>= 1;
+    }
+    return result;
+}
+
+// Returns x^-1 mod p for a plain (not Montgomery) x.
+static uint64_t BigInt_ntt_inverse(uint64_t x, const BigInt_ntt_modulus* modulus) {
+    uint64_t inverse = BigInt_ntt_power(BigInt_ntt_multiply(x % modulus->p, modulus->r2, modulus),
+        modulus->p - 2, modulus);
+    return BigInt_ntt_multiply(inverse, 1, modulus);
+}
+
+// In-place transform of the n values at a, with roots[j] = w^j for j < n/2
+// where w is a primitive nth root of unity.  Gentleman-Sande butterflies
+// take natural order to bit-reversed order.
+static void BigInt_ntt_forward(uint64_t* a, size_t n, const uint64_t* roots, const BigInt_ntt_modulus* modulus) {
+    uint64_t p = modulus->p;
+    for(size_t len = n, step = 1; len >= 2; len >>= 1, step <<= 1) {
+        size_t half = len / 2;
+        for(size_t start = 0; start < n; start += len) {
+            for(size_t j = 0; j < half; j++) {
+                uint64_t u = a[start + j];
+                uint64_t v = a[start + j + half];
+                a[start + j] = BigInt_ntt_add(u, v, p);
+                a[start + j + half] = BigInt_ntt_multiply(BigInt_ntt_subtract(u, v, p), roots[j * step], modulus);
+            }
+        }
+    }
+}
+
+// The inverse of BigInt_ntt_forward times n, given the inverse roots.
+// Cooley-Tukey butterflies take bit-reversed order back to natural order.
+static void BigInt_ntt_inverse_transform(uint64_t* a, size_t n, const uint64_t* roots, const BigInt_ntt_modulus* modulus) {
+    uint64_t p = modulus->p;
+    for(size_t len = 2, step = n / 2; len <= n; len <<= 1, step >>= 1) {
+        size_t half = len / 2;
+        for(size_t start = 0; start < n; start += len) {
+            for(size_t j = 0; j < half; j++) {
+                uint64_t u = a[start + j];
+                uint64_t v = BigInt_ntt_multiply(a[start + j + half], roots[j * step], modulus);
+                a[start + j] = BigInt_ntt_add(u, v, p);
+                a[start + j + half] = BigInt_ntt_subtract(u, v, p);
+            }
+        }
+    }
+}
+
+// Sets the n values at coefficients to the n digits at x grouped
+// BIGINT_NTT_GROUP at a time, mod p in Montgomery's form, padded with
+// zeros up to size.
+static void BigInt_ntt_load(uint64_t* coefficients, size_t size, const BigInt_digit* x, size_t n,
+        const BigInt_ntt_modulus* modulus) {
+    size_t i = 0;
+    for(size_t start = 0; start < n; start += BIGINT_NTT_GROUP, i++) {
+        uint64_t value = 0;
+        for(size_t t = MIN(n - start, BIGINT_NTT_GROUP); t-- > 0;) {
+            value = value * BIGINT_BASE + BIGINT_DIGIT_VALUE(x[start + t]);
+        }
+        coefficients[i] = BigInt_ntt_multiply(value % modulus->p, modulus->r2, modulus);
+    }
+    memset(&coefficients[i], 0, (size - i) * sizeof(uint64_t));
+}
+
+// Multiplies by convolving the operands' coefficients mod each of the
+// three primes and recombining the results by the Chinese remainder
+// theorem, carrying as we go.  Squares need one forward transform instead
+// of two per prime.
+static BOOL BigInt_digits_multiply_ntt(BigInt_digit* out, const BigInt_digit* a, size_t na,
+        const BigInt_digit* b, size_t nb, BigInt_arena* arena) {
+    size_t ca = (na + BIGINT_NTT_GROUP - 1) / BIGINT_NTT_GROUP;
+    size_t cb = (nb + BIGINT_NTT_GROUP - 1) / BIGINT_NTT_GROUP;
+    size_t n = 1;
+    int log = 0;
+    while(n < ca + cb - 1) {
+        n <<= 1;
+        log++;
+    }
+    size_t bytes;
+    if(log > BIGINT_NTT_MAX_LOG || !check_mul_size_size(n, 5 * sizeof(uint64_t), &bytes)) {
+        errno = ENOMEM;
+        return 0;
+    }
+    BOOL square = a == b && na == nb;
+
+    BigInt_arena_mark mark = BigInt_arena_save(arena);
+    uint64_t* buffer = BigInt_arena_alloc(arena, bytes);
+    if(!buffer) {
+        return 0;
+    }
+    uint64_t* residues[3] = {buffer, &buffer[n], &buffer[2 * n]};
+    uint64_t* work = &buffer[3 * n];
+    uint64_t* roots = &buffer[4 * n];
+    uint64_t* inverse_roots = &buffer[4 * n + n / 2];
+
+    BigInt_ntt_modulus moduli[3];
+    for(int i = 0; i < 3; i++) {
+        BigInt_ntt_modulus* modulus = &moduli[i];
+        BigInt_ntt_modulus_init(modulus, BigInt_ntt_primes[i][0]);
+        uint64_t generator = BigInt_ntt_multiply(BigInt_ntt_primes[i][1], modulus->r2, modulus);
+        uint64_t w = BigInt_ntt_power(generator, (modulus->p - 1) >> log, modulus);
+        uint64_t w_inverse = BigInt_ntt_power(w, n - 1, modulus);
+        uint64_t one = BigInt_ntt_multiply(1, modulus->r2, modulus);
+        for(size_t j = 0; j < n / 2; j++) {
+            roots[j] = j ? BigInt_ntt_multiply(roots[j - 1], w, modulus) : one;
+            inverse_roots[j] = j ? BigInt_ntt_multiply(inverse_roots[j - 1], w_inverse, modulus) : one;
+        }
+
+        uint64_t* c = residues[i];
+        BigInt_ntt_load(c, n, a, na, modulus);
+        BigInt_ntt_forward(c, n, roots, modulus);
+        if(square) {
+            for(size_t j = 0; j < n; j++) {
+                c[j] = BigInt_ntt_multiply(c[j], c[j], modulus);
+            }
+        } else {
+            BigInt_ntt_load(work, n, b, nb, modulus);
+            BigInt_ntt_forward(work, n, roots, modulus);
+            for(size_t j = 0; j < n; j++) {
+                c[j] = BigInt_ntt_multiply(c[j], work[j], modulus);
+            }
+        }
+        BigInt_ntt_inverse_transform(c, n, inverse_roots, modulus);
+        // dividing by n also takes the values out of Montgomery's form
+        uint64_t n_inverse = BigInt_ntt_inverse(n, modulus);
+        for(size_t j = 0; j < ca + cb - 1; j++) {
+            c[j] = BigInt_ntt_multiply(c[j], n_inverse, modulus);
+        }
+    }
+
+    // Garner's recombination: x = r0 + p0 * t1 + p0 * p1 * t2
+    uint64_t p0 = moduli[0].p;
+    uint64_t p1 = moduli[1].p;
+    uint64_t p2 = moduli[2].p;
+    uint64_t p0_inverse = BigInt_ntt_inverse(p0, &moduli[1]);
+    unsigned __int128 p01 = (unsigned __int128)p0 * p1;
+    uint64_t p01_inverse = BigInt_ntt_inverse((uint64_t)(p01 % p2), &moduli[2]);
+    uint64_t carry[3] = {0, 0, 0}; // three 64 bit words, low word first
+    memset(out, 0, (na + nb) * sizeof(BigInt_digit));
+    for(size_t k = 0, position = 0; position < na + nb; k++) {
+        uint64_t x[3] = {0, 0, 0};
+        if(k < ca + cb - 1) {
+            uint64_t r0 = residues[0][k];
+            uint64_t t1 = (uint64_t)((unsigned __int128)BigInt_ntt_subtract(residues[1][k], r0 % p1, p1)
+                * p0_inverse % p1);
+            unsigned __int128 x01 = (unsigned __int128)p0 * t1 + r0;
+            uint64_t t2 = (uint64_t)((unsigned __int128)BigInt_ntt_subtract(residues[2][k], (uint64_t)(x01 % p2), p2)
+                * p01_inverse % p2);
+            unsigned __int128 low = (unsigned __int128)(uint64_t)p01 * t2;
+            unsigned __int128 high = (unsigned __int128)(uint64_t)(p01 >> 64) * t2 + (uint64_t)(low >> 64);
+            unsigned __int128 sum = (unsigned __int128)(uint64_t)low + (uint64_t)x01;
+            x[0] = (uint64_t)sum;
+            sum = (sum >> 64) + (uint64_t)high + (uint64_t)(x01 >> 64);
+            x[1] = (uint64_t)sum;
+            x[2] = (uint64_t)((sum >> 64) + (uint64_t)(high >> 64));
+        }
+
+        // x += carry, then split off the coefficient's digits
+        unsigned __int128 sum = 0;
+        for(int w = 0; w < 3; w++) {
+            sum += (unsigned __int128)x[w] + carry[w];
+            x[w] = (uint64_t)sum;
+            sum >>= 64;
+        }
+        assert(!sum);
+#if BIGINT_REPR == BIGINT_REPR_BINARY64
+        uint64_t chunk = x[0];
+        carry[0] = x[1];
+        carry[1] = x[2];
+        carry[2] = 0;
+#else
+        const uint64_t chunk_base = (uint64_t)BIGINT_NTT_CHUNK_BASE;
+        unsigned __int128 remainder = 0;
+        for(int w = 3; w-- > 0;) {
+            unsigned __int128 dividend = (remainder << 64) | x[w];
+            carry[w] = (uint64_t)(dividend / chunk_base);
+            remainder = dividend % chunk_base;
+        }
+        uint64_t chunk = (uint64_t)remainder;
+#endif
+        for(int t = 0; t < BIGINT_NTT_GROUP; t++, position++) {
+            if(position >= na + nb) {
+                assert(!chunk);
+                break;
+            }
+            out[position] = BIGINT_DIGIT_FROM_VALUE(chunk % BIGINT_BASE);
+            chunk /= BIGINT_BASE;
+        }
+    }
+    assert(!carry[0] && !carry[1] && !carry[2]);
+
+    BigInt_arena_restore(arena, mark);
+    return 1;
+}
+#endif//BIGINT_NTT
+
+// Sets the na + nb digits at out to the product of the na digits at a and
+// the nb digits at b, picking the algorithm by operand size.  out must not
+// overlap a or b; temporaries come from arena.  When a and b are the same
+// digits, each algorithm takes its cheaper squaring path.
+// returns non-zero on success or 0 on failure
+static BOOL BigInt_digits_multiply(BigInt_digit* out, const BigInt_digit* a, size_t na,
+        const BigInt_digit* b, size_t nb, BigInt_arena* arena) {
+    if(na < nb) {
+        const BigInt_digit* digits = a;
+        a = b;
+        b = digits;
+        size_t num_digits = na;
+        na = nb;
+        nb = num_digits;
+    }
+    if(nb < BigInt_thresholds[BIGINT_THRESHOLD_KARATSUBA]) {
+        if(a == b && na == nb) {
+            BigInt_digits_square_basecase(out, a, na);
+        } else {
+            BigInt_digits_multiply_basecase(out, a, na, b, nb);
+        }
+        return 1;
+    }
+#if BIGINT_NTT
+    if(nb >= BigInt_thresholds[BIGINT_THRESHOLD_NTT]) {
+        return BigInt_digits_multiply_ntt(out, a, na, b, nb, arena);
+    }
+#endif
+    if(na >= 2 * nb) {
+        return BigInt_digits_multiply_unbalanced(out, a, na, b, nb, arena);
+    }
+    if(nb >= BigInt_thresholds[BIGINT_THRESHOLD_TOOM4]) {
+        return BigInt_digits_multiply_toom(out, a, na, b, nb, 4, arena);
+    }
+    if(nb >= BigInt_thresholds[BIGINT_THRESHOLD_TOOM3]) {
+        return BigInt_digits_multiply_toom(out, a, na, b, nb, 3, arena);
+    }
+    return BigInt_digits_multiply_karatsuba(out, a, na, b, nb, arena);
+}
+
+// The product is computed at the digit level (see BigInt_digits_multiply):
+// by the pencil and paper method for small operands, which is O(n*m) where
+// n, m are the number of digits in big_int and multiplier, and by
+// Karatsuba, Toom-Cook and the number theoretic transform for larger ones.
+BOOL BigInt_multiply(BigInt* big_int, const BigInt* multiplier) {
+    BOOL success = 0;
+
+    // Temporaries come from the scratch arena and are all released at once
+    // when we're done.
+    BigInt_arena* arena = BigInt_scratch_arena();
+    BigInt_arena_mark mark = BigInt_arena_save(arena);
+
+    // Need to keep track of the result in a separate variable because we need
+    // big_int to retain its original value throughout the course of the calculation.
+    BigInt result;
+    BOOL have_result = 0;
+    size_t result_digits;
+    if(!check_add_size_size(big_int->num_digits, multiplier->num_digits, &result_digits)) {
+        errno = ENOMEM;
+        goto cleanup;
+    }
+    have_result = BigInt_init_result(&result, big_int, arena, result_digits);
+    if(!have_result) {
+        goto cleanup;
+    }
+    if(!BigInt_digits_multiply(result.digits, big_int->digits, big_int->num_digits,
+            multiplier->digits, multiplier->num_digits, arena)) {
+        goto cleanup;
+    }
+    result.num_digits = result_digits;
+
+    // don't leave 0's in highest digit
+    BigInt_trim(&result);
+    result.is_negative = big_int->is_negative != multiplier->is_negative
+        && (result.num_digits > 1 || result.digits[0]);
+
+    // Hand the result to big_int and clean things up
+    success = BigInt_move(big_int, &result);
+cleanup:
+    if(have_result) {
+        BigInt_free_digits(&result);
+    }
+    BigInt_arena_restore(arena, mark);
+    return success;
+}
+
+// BigInt_multiply hands the kernels big_int's digits as both operands,
+// which they notice and square (so does a copy-on-write clone's).
+BOOL BigInt_square(BigInt* big_int) {
+    return BigInt_multiply(big_int, big_int);
+}
+
+// Multiplies the digits by the magnitude of multiplier in a single pass,
+// in place, appending whatever carry is left at the top.
+BOOL BigInt_multiply_int(BigInt* big_int, const int multiplier) {
+    unsigned int magnitude = multiplier < 0 ? 0u - (unsigned int)multiplier : (unsigned int)multiplier;
+    if(!magnitude) {
+        return BigInt_assign_int(big_int, 0);
+    }
+    size_t num_digits = big_int->num_digits;
+    if(num_digits == 1 && !big_int->digits[0]) {
+        return 1;
+    }
+    if(magnitude > 1) {
+        size_t digits_needed;
+        if(!check_add_size_size(num_digits, BigInt_count_digits(magnitude), &digits_needed)) {
+            errno = ENOMEM;
+            return 0;
+        }
+        if(!BigInt_ensure_digits(big_int, digits_needed)) {
+            return 0;
+        }
+        BigInt_digit* digits = big_int->digits;
+        BigInt_int_product carry = 0;
+        size_t i;
+        for(i = 0; i < num_digits; i++) {
+            BigInt_int_product total = (BigInt_int_product)BIGINT_DIGIT_VALUE(digits[i]) * magnitude + carry;
+            digits[i] = BIGINT_DIGIT_FROM_VALUE(total % BIGINT_BASE);
+            carry = total / BIGINT_BASE;
+        }
+        while(carry) {
+            digits[big_int->num_digits++] = BIGINT_DIGIT_FROM_VALUE(carry % BIGINT_BASE);
+            carry /= BIGINT_BASE;
+        }
+    }
+    if(multiplier < 0) {
+        big_int->is_negative = !big_int->is_negative;
+    }
+    return 1;
+}
+
+// Computes the product one window of chunk_digits output digits at a time:
+// every pair of chunks whose product lands in the window is accumulated
+// into acc, the window's finished digits are streamed to a temporary file
+// and the rest carries over to the next window.  Only once all of the
+// operands have been read is the product copied into big_int, so either
+// operand may be big_int itself.
+BOOL BigInt_multiply_out_of_core(BigInt* big_int, const BigInt* multiplier,
+        size_t memory_budget, BigInt_out_of_core_stats* stats) {
+    size_t na = big_int->num_digits;
+    size_t nb = multiplier->num_digits;
+    size_t product_digits;
+    if(!check_add_size_size(na, nb, &product_digits)) {
+        errno = ENOMEM;
+        return 0;
+    }
+
+    // A window accumulates up to min(chunks of a, chunks of b) products of
+    // 2 * chunk_digits digits, plus the carry from the previous window.
+    size_t slack = 2;
+    for(size_t chunks = MAX(na, nb); chunks; chunks /= BIGINT_BASE) {
+        slack++;
+    }
+    size_t budget_digits = memory_budget / sizeof(BigInt_digit);
+    if(budget_digits < slack + 2) {
+        errno = EINVAL;
+        return 0;
+    }
+    size_t chunk_digits = (budget_digits - slack) / 2;
+    size_t acc_digits = 2 * chunk_digits + slack;
+    size_t a_chunks = (na + chunk_digits - 1) / chunk_digits;
+    size_t b_chunks = (nb + chunk_digits - 1) / chunk_digits;
+
+    // straight from the allocator, so the budget covers every byte of it
+    const BigInt_allocator* allocator = BigInt_registered_allocator;
+    size_t acc_bytes = acc_digits * sizeof(BigInt_digit);
+    BigInt_digit* acc = allocator->alloc(allocator->context, acc_bytes);
+    FILE* spill = tmpfile();
+    BOOL success = 0;
+    size_t spilled = 0;
+    if(!acc || !spill) {
+        goto cleanup;
+    }
+    memset(acc, 0, acc_digits * sizeof(BigInt_digit));
+
+    for(size_t window = 0; window < a_chunks + b_chunks - 1; window++) {
+        size_t first = window >= b_chunks ? window - b_chunks + 1 : 0;
+        size_t last = window < a_chunks ? window : a_chunks - 1;
+        for(size_t i = first; i <= last; i++) {
+            size_t j = window - i;
+            size_t a_start = i * chunk_digits;
+            size_t b_start = j * chunk_digits;
+            size_t a_len = na - a_start < chunk_digits ? na - a_start : chunk_digits;
+            size_t b_len = nb - b_start < chunk_digits ? nb - b_start : chunk_digits;
+            BigInt_digits_multiply_accumulate(acc, &big_int->digits[a_start], a_len,
+                &multiplier->digits[b_start], b_len);
+        }
+        if(fwrite(acc, sizeof(BigInt_digit), chunk_digits, spill) != chunk_digits) {
+            goto cleanup;
+        }
+        spilled += chunk_digits;
+        memmove(acc, &acc[chunk_digits], (acc_digits - chunk_digits) * sizeof(BigInt_digit));
+        memset(&acc[acc_digits - chunk_digits], 0, chunk_digits * sizeof(BigInt_digit));
+    }
+    if(fwrite(acc, sizeof(BigInt_digit), acc_digits, spill) != acc_digits) {
+        goto cleanup;
+    }
+    spilled += acc_digits;
+
+    // The product has at most na + nb digits; anything above is zero.
+    BOOL is_negative = big_int->is_negative != multiplier->is_negative;
+    rewind(spill);
+    if(!BigInt_ensure_digits(big_int, product_digits)) {
+        goto cleanup;
+    }
+    if(fread(big_int->digits, sizeof(BigInt_digit), product_digits, spill) != product_digits) {
+        goto cleanup;
+    }
+    big_int->num_digits = product_digits;
+    big_int->is_negative = is_negative;
+    BigInt_trim(big_int);
+    if(big_int->num_digits == 1 && !big_int->digits[0]) {
+        big_int->is_negative = 0;
+    }
+    success = 1;
+
+cleanup:
+    if(spill) {
+        fclose(spill);
+    }
+    if(acc) {
+        allocator->free(allocator->context, acc, acc_bytes);
+    }
+    if(stats) {
+        stats->chunk_digits = chunk_digits;
+        stats->peak_bytes = acc_bytes;
+        stats->bytes_spilled = spilled * sizeof(BigInt_digit);
+    }
+    return success;
+}
+
+//============================================================================
+// Division kernels
+//============================================================================
+
+// Divides the nu digits at u by the nv digits at v, where nu >= nv >= 2 and
+// the top digit of v isn't zero, by Knuth's Algorithm D (The Art of Computer
+// Programming, vol. 2, 4.3.1).  Writes the nu - nv + 1 digits of the
+// quotient to q and the nv digits of the remainder to r.  q must not
+// overlap u or v; r may be u.
+static BOOL BigInt_digits_divide_knuth(BigInt_digit* q, BigInt_digit* r,
+        const BigInt_digit* u, size_t nu, const BigInt_digit* v, size_t nv, BigInt_arena* arena) {
+    BigInt_arena_mark mark = BigInt_arena_save(arena);
+    BigInt_digit* un = BigInt_arena_alloc(arena, (nu + 1 + nv) * sizeof(BigInt_digit));
+    if(!un) {
+        return 0;
+    }
+    BigInt_digit* vn = &un[nu + 1];
+
+    // Scale both operands so that the top digit of the divisor is at least
+    // BIGINT_BASE / 2; each quotient digit estimated from the top digits is
+    // then at most two too large.
+    BigInt_digit scale = (BigInt_digit)(BIGINT_BASE / ((BigInt_double_digit)BIGINT_DIGIT_VALUE(v[nv - 1]) + 1));
+    memcpy(un, u, nu * sizeof(BigInt_digit));
+    memcpy(vn, v, nv * sizeof(BigInt_digit));
+    un[nu] = 0;
+    if(scale > 1) {
+        un[nu] = BigInt_digits_multiply_add(un, nu, scale, 0);
+        BigInt_digit carry = BigInt_digits_multiply_add(vn, nv, scale, 0);
+        assert(!carry);
+        (void)carry;
+    }
+
+    BigInt_double_digit v1 = BIGINT_DIGIT_VALUE(vn[nv - 1]);
+    BigInt_double_digit v2 = BIGINT_DIGIT_VALUE(vn[nv - 2]);
+    size_t j = nu - nv + 1;
+    while(j--) {
+        // Estimate the quotient digit from the top two digits of the
+        // remainder and the divisor, then correct it with the third
+        // remainder digit and the second divisor digit.  This leaves it at
+        // most one too large.
+        BigInt_digit* window = &un[j];
+        BigInt_double_digit top = (BigInt_double_digit)BIGINT_DIGIT_VALUE(window[nv]) * BIGINT_BASE
+            + BIGINT_DIGIT_VALUE(window[nv - 1]);
+        BigInt_double_digit qhat = top / v1;
+        BigInt_double_digit rhat = top % v1;
+        while(qhat >= BIGINT_BASE || qhat * v2 > rhat * BIGINT_BASE + BIGINT_DIGIT_VALUE(window[nv - 2])) {
+            qhat--;
+            rhat += v1;
+            if(rhat >= BIGINT_BASE) {
+                break;
+            }
+        }
+
+        // Subtract qhat times the divisor from the window of the remainder
+        BigInt_double_digit carry = 0;
+        int borrow = 0;
+        for(size_t i = 0; i < nv; i++) {
+            BigInt_double_digit product = qhat * BIGINT_DIGIT_VALUE(vn[i]) + carry;
+            carry = product / BIGINT_BASE;
+            window[i] = BigInt_digit_subtract(window[i], BIGINT_DIGIT_FROM_VALUE(product % BIGINT_BASE), &borrow);
+        }
+        window[nv] = BigInt_digit_subtract(window[nv], BIGINT_DIGIT_FROM_VALUE(carry), &borrow);
+
+        // The remainder went negative, so qhat was one too large: add the
+        // divisor back.  The carry out cancels the borrow.
+        if(borrow) {
+            qhat--;
+            BigInt_digits_add(window, window, nv + 1, vn, nv);
+        }
+        q[j] = BIGINT_DIGIT_FROM_VALUE(qhat);
+    }
+
+    // The remainder is what's left, scaled back down
+    memcpy(r, un, nv * sizeof(BigInt_digit));
+    if(scale > 1) {
+        BigInt_digits_divide_small(r, r, nv, scale);
+    }
+    BigInt_arena_restore(arena, mark);
+    return 1;
+}
+
+// Burnikel and Ziegler's recursive division ("Fast Recursive Division",
+// MPI-I-98-1-022, 1998).  The three functions below share its conventions:
+// the divisor b is normalized, its top digit at least BIGINT_BASE / 2, and
+// each dividend a is less than b times BIGINT_BASE to the power of the
+// quotient's length, so the quotient fits.  The remainder replaces the low
+// digits of a; the digits above it are left undefined.
+
+static BOOL BigInt_digits_divide_2n1n(BigInt_digit* q, BigInt_digit* a,
+        const BigInt_digit* b, size_t n, BigInt_arena* arena);
+
+// Divides the 3h digits at a by the 2h digits at b, writing the h digits of
+// the quotient to q and leaving the remainder in the low 2h digits of a.
+// The quotient is estimated by dividing the top 2h digits of a by the top h
+// digits of b, which is at most two too large.
+static BOOL BigInt_digits_divide_3n2n(BigInt_digit* q, BigInt_digit* a,
+        const BigInt_digit* b, size_t h, BigInt_arena* arena) {
+    const BigInt_digit* b1 = &b[h];
+    // the remainder can run one digit past a's low 2h digits
+    int top = 0;
+    if(BigInt_digits_compare(&a[2 * h], h, b1, h) < 0) {
+        // a's top h digits are below b1, so the estimate fits in h digits
+        if(!BigInt_digits_divide_2n1n(q, &a[h], b1, h, arena)) {
+            return 0;
+        }
+    } else {
+        // a's top h digits equal b1: the estimate is BIGINT_BASE^h - 1, and
+        // what's left of a's top 2h digits is their low half plus b1
+        for(size_t i = 0; i < h; i++) {
+            q[i] = BIGINT_DIGIT_FROM_VALUE(BIGINT_BASE - 1);
+        }
+        top = BigInt_digits_add(&a[h], &a[h], h, b1, h);
+    }
+
+    // Subtract the estimate times the rest of b, adding b back while that
+    // leaves the remainder negative
+    BigInt_arena_mark mark = BigInt_arena_save(arena);
+    BigInt_digit* product = BigInt_arena_alloc(arena, 2 * h * sizeof(BigInt_digit));
+    if(!product || !BigInt_digits_multiply(product, q, h, b, h, arena)) {
+        return 0;
+    }
+    top -= BigInt_digits_subtract(a, a, 2 * h, product, 2 * h);
+    BigInt_arena_restore(arena, mark);
+    const BigInt_digit one = BIGINT_DIGIT_FROM_VALUE(1);
+    while(top < 0) {
+        BigInt_digits_subtract(q, q, h, &one, 1);
+        top += BigInt_digits_add(a, a, 2 * h, b, 2 * h);
+    }
+    assert(top == 0);
+    return 1;
+}
+
+// Divides the 2n digits at a by the n digits at b, writing the n digits of
+// the quotient to q and leaving the remainder in the low n digits of a.
+// Halves n by two calls to BigInt_digits_divide_3n2n, one for each half of
+// the quotient, until it is odd or below BIGINT_THRESHOLD_DIVIDE.
+static BOOL BigInt_digits_divide_2n1n(BigInt_digit* q, BigInt_digit* a,
+        const BigInt_digit* b, size_t n, BigInt_arena* arena) {
+    if(n % 2 || n < BigInt_thresholds[BIGINT_THRESHOLD_DIVIDE]) {
+        BigInt_arena_mark mark = BigInt_arena_save(arena);
+        // long division writes a leading zero digit on top of the quotient
+        BigInt_digit* quotient = BigInt_arena_alloc(arena, (n + 1) * sizeof(BigInt_digit));
+        if(!quotient || !BigInt_digits_divide_knuth(quotient, a, a, 2 * n, b, n, arena)) {
+            return 0;
+        }
+        assert(!quotient[n]);
+        memcpy(q, quotient, n * sizeof(BigInt_digit));
+        BigInt_arena_restore(arena, mark);
+        return 1;
+    }
+    size_t h = n / 2;
+    return BigInt_digits_divide_3n2n(&q[h], &a[h], b, h, arena)
+        && BigInt_digits_divide_3n2n(q, a, b, h, arena);
+}
+
+// Divides the nu digits at u by the nv digits at v, where nu >= nv >= 2 and
+// the top digit of v isn't zero, with the same results as
+// BigInt_digits_divide_knuth.  v is scaled as for long division and padded
+// with low zero digits to n digits, where n is a power of two times a size
+// below BIGINT_THRESHOLD_DIVIDE, so it halves evenly all the way down.
+// u, scaled and padded the same way, is then divided n digits at a time,
+// each step dividing the remainder so far and the next n digits of u by v
+// with BigInt_digits_divide_2n1n.
+static BOOL BigInt_digits_divide_recursive(BigInt_digit* q, BigInt_digit* r,
+        const BigInt_digit* u, size_t nu, const BigInt_digit* v, size_t nv, BigInt_arena* arena) {
+    size_t n = nv;
+    unsigned int levels = 0;
+    while(n >= BigInt_thresholds[BIGINT_THRESHOLD_DIVIDE]) {
+        n = (n + 1) / 2;
+        levels++;
+    }
+    n <<= levels;
+    size_t shift = n - nv;
+    // Room for u's scaled digits and a zero digit above them, so the top
+    // block is below v.  At least two blocks.
+    size_t blocks = MAX((nu + shift + 2 + n - 1) / n, 2);
+
+    BigInt_arena_mark mark = BigInt_arena_save(arena);
+    BigInt_digit* un = BigInt_arena_alloc(arena, (2 * blocks * n) * sizeof(BigInt_digit));
+    if(!un) {
+        return 0;
+    }
+    BigInt_digit* vn = &un[blocks * n];
+    BigInt_digit* qn = &vn[n];
+
+    BigInt_digit scale = (BigInt_digit)(BIGINT_BASE / ((BigInt_double_digit)BIGINT_DIGIT_VALUE(v[nv - 1]) + 1));
+    memset(un, 0, blocks * n * sizeof(BigInt_digit));
+    memcpy(&un[shift], u, nu * sizeof(BigInt_digit));
+    memset(vn, 0, shift * sizeof(BigInt_digit));
+    memcpy(&vn[shift], v, nv * sizeof(BigInt_digit));
+    if(scale > 1) {
+        un[shift + nu] = BigInt_digits_multiply_add(&un[shift], nu, scale, 0);
+        BigInt_digit carry = BigInt_digits_multiply_add(&vn[shift], nv, scale, 0);
+        assert(!carry);
+        (void)carry;
+    }
+
+    size_t i = blocks - 1;
+    while(i--) {
+        if(!BigInt_digits_divide_2n1n(&qn[i * n], &un[i * n], vn, n, arena)) {
             return 0;
         }
     }
-    
-    // Figure out the sign
-    big_int->is_negative = result_is_negative;
+
+    memcpy(q, qn, (nu - nv + 1) * sizeof(BigInt_digit));
+    memcpy(r, &un[shift], nv * sizeof(BigInt_digit));
+    if(scale > 1) {
+        BigInt_digits_divide_small(r, r, nv, scale);
+    }
+    BigInt_arena_restore(arena, mark);
     return 1;
 }
 
+// Exact division works from the least significant digit up (Jebelean, "An
+// exact division algorithm", 1993): the lowest digit of what is left of
+// the dividend fixes the lowest digit of the quotient, as that digit times
+// the inverse of the divisor modulo BIGINT_BASE, so no quotient digit is
+// ever estimated or corrected.  The divisor's lowest digit must share no
+// factor with BIGINT_BASE; these are the primes to divide out first.
+#if BIGINT_REPR == BIGINT_REPR_BINARY64
+static const unsigned int BigInt_base_primes[] = {2};
+#else
+static const unsigned int BigInt_base_primes[] = {2, 5};
+#endif
 
-BOOL BigInt_subtract_int(BigInt* big_int, const int to_subtract) {
-    BigInt* big_int_to_subtract = BigInt_construct(to_subtract);
-    if(!big_int_to_subtract) {
-        return 0;
+// Returns the inverse of d modulo BIGINT_BASE, with which it has no common
+// factor, by the extended Euclidean algorithm.
+static BigInt_int_word BigInt_inverse_mod_base(BigInt_int_word d) {
+    // r is congruent to s * d and old_r to old_s * d throughout
+    BigInt_int_product old_r = BIGINT_BASE;
+    BigInt_int_product r = d % BIGINT_BASE;
+    BigInt_int_product old_s = 0;
+    BigInt_int_product s = 1;
+    while(r) {
+        BigInt_int_product q = old_r / r;
+        BigInt_int_product next = old_r - q * r;
+        old_r = r;
+        r = next;
+        next = (old_s + BIGINT_BASE - q * s % BIGINT_BASE) % BIGINT_BASE;
+        old_s = s;
+        s = next;
+    }
+    assert(old_r == 1);
+    return (BigInt_int_word)old_s;
+}
+
+// Divides the num_digits digits at digits by divisor in place, exactly,
+// from the least significant digit up.  Returns what is carried out of the
+// top digit, which is 0 exactly when divisor divides the digits.
+static BigInt_int_word BigInt_digits_divide_exact_small(BigInt_digit* digits, size_t num_digits,
+        BigInt_int_word divisor) {
+    BigInt_int_product inverse = BigInt_inverse_mod_base(divisor);
+    // what is still to be taken from the digits above, which may be more
+    // than a digit when divisor is
+    BigInt_int_word carry = 0;
+    for(size_t i = 0; i < num_digits; i++) {
+        BigInt_int_product digit = BIGINT_DIGIT_VALUE(digits[i]);
+        BigInt_int_word borrow = carry / BIGINT_BASE;
+        BigInt_int_product low = carry % BIGINT_BASE;
+        if(digit < low) {
+            digit += BIGINT_BASE;
+            borrow++;
+        }
+        digit -= low;
+        BigInt_int_product q = digit * inverse % BIGINT_BASE;
+        // q * divisor ends in digit, and the rest is carried
+        carry = (BigInt_int_word)((q * divisor - digit) / BIGINT_BASE) + borrow;
+        digits[i] = BIGINT_DIGIT_FROM_VALUE(q);
     }
-    BOOL result = BigInt_subtract(big_int, big_int_to_subtract);
-    BigInt_free(big_int_to_subtract);
-    return result;
+    return carry;
 }
 
-BOOL BigInt_subtract_digits(BigInt* big_int, const BigInt* to_subtract) {
+// Divides the nu digits at u by the nv digits at v, which divide them
+// exactly, from the least significant digit up.  The nq = nu - nv + 1 low
+// digits of u are replaced by the quotient.  Only the low nq digits of u
+// and v take part, so the cost is nq * min(nq, nv); debug builds carry on
+// through the rest of u and assert it cancels out.
+static void BigInt_digits_divide_exact(BigInt_digit* u, size_t nu, const BigInt_digit* v, size_t nv) {
+    size_t nq = nu - nv + 1;
+    BigInt_double_digit inverse = BigInt_inverse_mod_base(BIGINT_DIGIT_VALUE(v[0]));
+#ifdef NDEBUG
+    size_t limit = nq;
+#else
+    size_t limit = nu;
+#endif
+    for(size_t i = 0; i < nq; i++) {
+        BigInt_double_digit q = BIGINT_DIGIT_VALUE(u[i]) * inverse % BIGINT_BASE;
+        if(!q) {
+            continue;
+        }
+        // subtract q * v, which clears u[i], and keep q in its place
+        size_t count = MIN(nv, limit - i);
+        BigInt_double_digit carry = 0;
+        int borrow = 0;
+        size_t j;
+        for(j = 0; j < count; j++) {
+            BigInt_double_digit product = q * BIGINT_DIGIT_VALUE(v[j]) + carry;
+            carry = product / BIGINT_BASE;
+            u[i + j] = BigInt_digit_subtract(u[i + j], BIGINT_DIGIT_FROM_VALUE(product % BIGINT_BASE), &borrow);
+        }
+        for(j += i; (carry || borrow) && j < limit; j++) {
+            u[j] = BigInt_digit_subtract(u[j], BIGINT_DIGIT_FROM_VALUE(carry), &borrow);
+            carry = 0;
+        }
+        assert(!u[i]);
+        u[i] = BIGINT_DIGIT_FROM_VALUE(q);
+    }
+#ifndef NDEBUG
+    for(size_t i = nq; i < nu; i++) {
+        assert(!u[i]); // the divisor didn't divide exactly
+    }
+#endif
+}
 
-    unsigned int digits_needed = MAX(big_int->num_digits, to_subtract->num_digits) + 1;
-    if(!BigInt_ensure_digits(big_int, digits_needed)) {
+// Long division, by Knuth's Algorithm D (see BigInt_digits_divide_knuth) or
+// for one-digit divisors a single pass over the dividend.  Once both the
+// divisor and the quotient reach BIGINT_THRESHOLD_DIVIDE digits it switches
+// to recursive division, which costs a small multiple of a multiplication
+// of the same size.  The quotient is truncated toward zero and the
+// remainder takes the sign of the dividend, as with C's / and % operators.
+BOOL BigInt_divide(
+    BigInt* dividend, BigInt* divisor,
+    BigInt* quotient, BigInt* remainder)
+{
+    int result = 0; // default to failure
+
+    if(!BigInt_compare_int(divisor, 0)) {
+        errno = ERANGE; // even BigInt can't represent infinity
         return 0;
     }
 
-    // Determine the larger int.  This will go on "top"
-    // of the subtraction.  Sign doesn't matter here since we've already
-    // determined the sign of the final result above.
-    unsigned char* greater_int_digits;
-    unsigned char* smaller_int_digits;
-    unsigned int smaller_int_num_digits;
-    unsigned int greater_int_num_digits;
+    // Temporaries come from the scratch arena and are all released at once
+    // when we're done.
+    BigInt_arena* arena = BigInt_scratch_arena();
+    BigInt_arena_mark mark = BigInt_arena_save(arena);
 
-    if(BigInt_compare_digits(big_int, to_subtract) > 0) {
-        greater_int_digits = big_int->digits;
-        greater_int_num_digits = big_int->num_digits;
-        smaller_int_digits = to_subtract->digits;
-        smaller_int_num_digits = to_subtract->num_digits;
-    } else {
-        greater_int_digits = to_subtract->digits;
-        greater_int_num_digits = to_subtract->num_digits;
-        smaller_int_digits = big_int->digits;
-        smaller_int_num_digits = big_int->num_digits;
+    size_t nu = dividend->num_digits;
+    size_t nv = divisor->num_digits;
+    BigInt quotient_storage, remainder_storage;
+    BigInt* _quotient = NULL;
+    BigInt* _remainder = NULL;
+    if(BigInt_init_result(&quotient_storage, quotient, arena, nu)) {
+        _quotient = &quotient_storage;
+    }
+    if(BigInt_init_result(&remainder_storage, remainder, arena, nv)) {
+        _remainder = &remainder_storage;
+    }
+    if(!_quotient || !_remainder) {
+        goto cleanup;
     }
 
-    // Actually carry out the subtraction.
-    int i;
-    int carry = 0;
-    big_int->num_digits = 1;
-
-    for(i = 0; i < greater_int_num_digits; ++i) {
-        int new_digit;
-        if(i < smaller_int_num_digits) {
-            new_digit = (int)greater_int_digits[i] - (int)smaller_int_digits[i] + carry;
-        } else {
-            new_digit = (int)greater_int_digits[i] + carry;
+    if(BigInt_compare_digits(dividend, divisor) < 0) {
+        // _quotient is already 0
+        memcpy(_remainder->digits, dividend->digits, nu * sizeof(BigInt_digit));
+        _remainder->num_digits = nu;
+    } else if(nv == 1) {
+        memcpy(_quotient->digits, dividend->digits, nu * sizeof(BigInt_digit));
+        _quotient->num_digits = nu;
+        BigInt_int_word digit = BigInt_digits_divide_small(_quotient->digits, _quotient->digits, nu,
+            BIGINT_DIGIT_VALUE(divisor->digits[0]));
+        _remainder->digits[0] = BIGINT_DIGIT_FROM_VALUE(digit);
+    } else {
+        size_t threshold = BigInt_thresholds[BIGINT_THRESHOLD_DIVIDE];
+        if(nv >= threshold && nu - nv >= threshold) {
+            if(!BigInt_digits_divide_recursive(_quotient->digits, _remainder->digits,
+                    dividend->digits, nu, divisor->digits, nv, arena)) {
+                goto cleanup;
+            }
+        } else if(!BigInt_digits_divide_knuth(_quotient->digits, _remainder->digits,
+                dividend->digits, nu, divisor->digits, nv, arena)) {
+            goto cleanup;
         }
+        _quotient->num_digits = nu - nv + 1;
+        _remainder->num_digits = nv;
+    }
+    BigInt_trim(_quotient);
+    BigInt_trim(_remainder);
+    _quotient->is_negative = dividend->is_negative != divisor->is_negative
+        && (_quotient->num_digits > 1 || _quotient->digits[0]);
+    _remainder->is_negative = dividend->is_negative
+        && (_remainder->num_digits > 1 || _remainder->digits[0]);
 
-        // Carry 10 from the next digit if necessary
-        if(new_digit < 0) {
-            carry = -1;
-            new_digit += 10;
-        } else {
-            carry = 0;
+    if(quotient) {
+        if(!BigInt_move(quotient, _quotient)) {
+            goto cleanup;
         }
-
-        assert(new_digit >= 0);
-        big_int->digits[i] = new_digit;
-        if(new_digit != 0) {
-            big_int->num_digits = i + 1;
+    }
+    if(remainder) {
+        if(!BigInt_move(remainder, _remainder)) {
+            goto cleanup;
         }
     }
+    
+    result = 1;
+cleanup:
+    if(_remainder) {
+        BigInt_free_digits(_remainder);
+    }
+    if(_quotient) {
+        BigInt_free_digits(_quotient);
+    }
+    BigInt_arena_restore(arena, mark);
+    return result;
+}
 
-    assert(carry == 0);
+// A single pass of BigInt_digits_divide_small over big_int's own digits.
+BOOL BigInt_divide_int(BigInt* big_int, const int divisor, int* remainder) {
+    if(!divisor) {
+        errno = ERANGE;
+        return 0;
+    }
+    // take a private copy of shared digits, without growing
+    if(!BigInt_ensure_digits(big_int, big_int->num_digits)) {
+        return 0;
+    }
+    unsigned int magnitude = divisor < 0 ? 0u - (unsigned int)divisor : (unsigned int)divisor;
+    BigInt_int_word r = BigInt_digits_divide_small(big_int->digits, big_int->digits,
+        big_int->num_digits, magnitude);
+    if(remainder) {
+        // below the magnitude of divisor, so it fits either way
+        *remainder = big_int->is_negative ? -(int)r : (int)r;
+    }
+    BigInt_trim(big_int);
+    if(big_int->num_digits == 1 && !big_int->digits[0]) {
+        big_int->is_negative = 0;
+    } else if(divisor < 0) {
+        big_int->is_negative = !big_int->is_negative;
+    }
     return 1;
 }
 
-// Multiply using the pencil and paper method.  Complexity is O(n*m) where n, m are
-// the number of digits in big_int and multiplier, respectively.
-BOOL BigInt_multiply(BigInt* big_int, const BigInt* multiplier) {
-
-    // Need to keep track of the result in a separate variable because we need
-    // big_int to retain its original value throughout the course of the calculation.
-    BigInt* result = BigInt_construct(0);
-    if(!result) {
+BOOL BigInt_mod_int(const BigInt* big_int, const int divisor, int* remainder) {
+    if(!divisor) {
+        errno = ERANGE;
         return 0;
     }
+    if(!remainder) {
+        return 1;
+    }
+    unsigned int magnitude = divisor < 0 ? 0u - (unsigned int)divisor : (unsigned int)divisor;
+    BigInt_int_word r = BigInt_digits_divide_small(NULL, big_int->digits, big_int->num_digits, magnitude);
+    *remainder = big_int->is_negative ? -(int)r : (int)r;
+    return 1;
+}
+
+// Drops the num_digits least significant digits of big_int, which has more
+// digits than that.
+static void BigInt_drop_low_digits(BigInt* big_int, size_t num_digits) {
+    big_int->num_digits -= num_digits;
+    memmove(big_int->digits, &big_int->digits[num_digits], big_int->num_digits * sizeof(BigInt_digit));
+}
 
-    // addend will hold the amount to be added to the result for each step of
-    // the multiplication.
-    BigInt* addend = BigInt_construct(0);
-    if(!addend) {
-        BigInt_free(result);
+BOOL BigInt_divexact_int(BigInt* big_int, const int divisor) {
+    if(!divisor) {
+        errno = ERANGE;
         return 0;
     }
-
-    unsigned int digits_needed = big_int->num_digits + multiplier->num_digits + 1;
-    if(!BigInt_ensure_digits(addend, digits_needed)) {
-        BigInt_free(result);
-        BigInt_free(addend);
+    // take a private copy of shared digits, without growing
+    if(!BigInt_ensure_digits(big_int, big_int->num_digits)) {
         return 0;
     }
+    unsigned int magnitude = divisor < 0 ? 0u - (unsigned int)divisor : (unsigned int)divisor;
 
-    int i, j;
-    int carry = 0;
-    for(i = 0; i < multiplier->num_digits; ++i) {
-
-        if(i > 0) {
-            addend->num_digits = i;
-            addend->digits[i - 1] = 0;
+    // The factors divisor shares with BIGINT_BASE are divided out from the
+    // top, the rest from the bottom.
+    unsigned int shared = 1;
+    for(size_t p = 0; p < sizeof(BigInt_base_primes) / sizeof(BigInt_base_primes[0]); p++) {
+        while(!(magnitude % BigInt_base_primes[p])) {
+            magnitude /= BigInt_base_primes[p];
+            shared *= BigInt_base_primes[p];
         }
+    }
+    if(shared > 1) {
+        BigInt_int_word r = BigInt_digits_divide_small(big_int->digits, big_int->digits,
+            big_int->num_digits, shared);
+        assert(!r); // divisor doesn't divide big_int
+        (void)r;
+    }
+    if(magnitude > 1) {
+        BigInt_int_word carry = BigInt_digits_divide_exact_small(big_int->digits, big_int->num_digits, magnitude);
+        assert(!carry); // divisor doesn't divide big_int
+        (void)carry;
+    }
 
-        for(j = 0; j < big_int->num_digits || carry > 0; ++j) { // TODO FIXME: potential infinite loop
-            if(j + i == addend->num_digits) {
-                ++addend->num_digits;
-            }
-
-            assert(digits_needed >= j + 1);
+    BigInt_trim(big_int);
+    if(big_int->num_digits == 1 && !big_int->digits[0]) {
+        big_int->is_negative = 0;
+    } else if(divisor < 0) {
+        big_int->is_negative = !big_int->is_negative;
+    }
+    return 1;
+}
 
-            int total;
-            if(j < big_int->num_digits) {
-                total = (big_int->digits[j] * multiplier->digits[i]) + carry;
-            } else {
-                total = carry;
-            }
+BOOL BigInt_divexact(BigInt* big_int, const BigInt* divisor) {
+    if(!BigInt_compare_int(divisor, 0)) {
+        errno = ERANGE;
+        return 0;
+    }
+    if(big_int->num_digits == 1 && !big_int->digits[0]) {
+        return 1;
+    }
+    BOOL is_negative = big_int->is_negative != divisor->is_negative;
+    if(!BigInt_ensure_digits(big_int, big_int->num_digits)) {
+        return 0;
+    }
 
-            addend->digits[i + j] = total % 10;
-            carry = total / 10;
+    BOOL success = 0;
+    BigInt_arena* arena = BigInt_scratch_arena();
+    BigInt_arena_mark mark = BigInt_arena_save(arena);
+    // the divisor is reduced along with big_int, so work on a copy
+    BigInt v;
+    BOOL have_v = BigInt_init_scratch(&v, arena, divisor->num_digits);
+    if(!have_v) {
+        goto cleanup;
+    }
+    memcpy(v.digits, divisor->digits, divisor->num_digits * sizeof(BigInt_digit));
+    v.num_digits = divisor->num_digits;
+
+    // Divide both by whatever the lowest digit of the divisor shares with
+    // BIGINT_BASE: whole zero digits, then the largest power of each prime
+    // of the base that fits in an int, until none is left.
+    for(;;) {
+        // Stop short of big_int's top digit even when divisor doesn't divide
+        // it, so that a build without asserts never drops every digit.
+        size_t zeros = 0;
+        while(!v.digits[zeros] && zeros + 1 < big_int->num_digits) {
+            assert(!big_int->digits[zeros]); // divisor doesn't divide big_int
+            zeros++;
         }
-
-        if(!BigInt_add(result, addend)) {
-            BigInt_free(result);
-            BigInt_free(addend);
-            return 0;
+        assert(v.digits[zeros]); // divisor doesn't divide big_int
+        if(zeros) {
+            BigInt_drop_low_digits(&v, zeros);
+            BigInt_drop_low_digits(big_int, zeros);
         }
+        BigInt_int_word low = BIGINT_DIGIT_VALUE(v.digits[0]);
+        size_t p = 0;
+        while(p < sizeof(BigInt_base_primes) / sizeof(BigInt_base_primes[0]) && low % BigInt_base_primes[p]) {
+            p++;
+        }
+        if(p == sizeof(BigInt_base_primes) / sizeof(BigInt_base_primes[0])) {
+            break;
+        }
+        unsigned int power = BigInt_base_primes[p];
+        while(power <= INT_MAX / BigInt_base_primes[p]) {
+            power *= BigInt_base_primes[p];
+        }
+        // the largest power of the prime that divides v, up to power
+        BigInt_int_word r = BigInt_digits_divide_small(NULL, v.digits, v.num_digits, power);
+        unsigned int factor = 1;
+        while(factor < power && !((r ? r : power) % (factor * BigInt_base_primes[p]))) {
+            factor *= BigInt_base_primes[p];
+        }
+        BigInt_digits_divide_small(v.digits, v.digits, v.num_digits, factor);
+        BigInt_trim(&v);
+        r = BigInt_digits_divide_small(big_int->digits, big_int->digits, big_int->num_digits, factor);
+        assert(!r); // divisor doesn't divide big_int
+        BigInt_trim(big_int);
+    }
+
+    if(BigInt_compare_digits(big_int, &v) < 0) {
+        assert(!BigInt_compare_int(big_int, 0)); // divisor doesn't divide big_int
+        big_int->num_digits = 1;
+        big_int->digits[0] = 0;
+    } else if(v.num_digits >= BigInt_thresholds[BIGINT_THRESHOLD_DIVIDE]
+            && big_int->num_digits - v.num_digits >= BigInt_thresholds[BIGINT_THRESHOLD_DIVIDE]
+            && (big_int->num_digits - v.num_digits) * 4 >= v.num_digits) {
+        // Hensel division takes about as many steps as long division, or the
+        // square of the quotient's length if that is smaller, so unless the
+        // quotient is much shorter than the divisor leave large ones to the
+        // recursive division, which runs on the multiplication algorithms
+        BigInt remainder;
+        BigInt_init_scratch(&remainder, NULL, 0);
+        BOOL divided = BigInt_divide(big_int, &v, big_int, &remainder);
+        assert(!divided || !BigInt_compare_int(&remainder, 0)); // divisor doesn't divide big_int
+        BigInt_free_digits(&remainder);
+        if(!divided) {
+            goto cleanup;
+        }
+    } else if(v.num_digits == 1) {
+        BigInt_int_word carry = BigInt_digits_divide_exact_small(big_int->digits, big_int->num_digits,
+            BIGINT_DIGIT_VALUE(v.digits[0]));
+        assert(!carry); // divisor doesn't divide big_int
+        (void)carry;
+    } else {
+        BigInt_digits_divide_exact(big_int->digits, big_int->num_digits, v.digits, v.num_digits);
+        big_int->num_digits = big_int->num_digits - v.num_digits + 1;
     }
-
-    result->is_negative = big_int->is_negative != multiplier->is_negative;
-
-    // don't leave 0's in highest digit
-    while(result->num_digits > 1 && !result->digits[result->num_digits-1]) {
-        result->num_digits--;
+    BigInt_trim(big_int);
+    big_int->is_negative = is_negative && (big_int->num_digits > 1 || big_int->digits[0]);
+    success = 1;
+cleanup:
+    if(have_v) {
+        BigInt_free_digits(&v);
     }
-
-    // Place the result in big_int and clean things up
-    BOOL success = BigInt_assign(big_int, result);
-    BigInt_free(result);
-    BigInt_free(addend);
+    BigInt_arena_restore(arena, mark);
     return success;
 }
 
-BOOL BigInt_multiply_int(BigInt* big_int, const int multiplier) {
-    BigInt* big_int_multiplier = BigInt_construct(multiplier);
-    if(!big_int_multiplier) {
+// Reduction modulo the n digits at m, whose top digit isn't zero, by
+// Barrett's method (Menezes et al., Handbook of Applied Cryptography,
+// 14.42): mu holds the nmu digits of floor(BASE^2n / m), and the buffers
+// are sized for the product of two n digit residues, so one set serves a
+// whole exponentiation.
+typedef struct {
+    const BigInt_digit* m;
+    size_t n;
+    const BigInt_digit* mu;
+    size_t nmu;
+    BigInt_digit* product;  // 2n digits
+    BigInt_digit* estimate; // n + 1 + nmu digits
+    BigInt_digit* back;     // 2n + 1 digits
+    BigInt_arena* arena;
+} BigInt_barrett;
+
+// Sets the n digits at out to a * b mod m, for n digit residues a and b.
+// out may be a or b; when a and b are the same, this squares.
+// returns non-zero on success or 0 on failure
+static BOOL BigInt_barrett_multiply(BigInt_barrett* barrett, BigInt_digit* out,
+        const BigInt_digit* a, const BigInt_digit* b) {
+    size_t n = barrett->n;
+    BigInt_digit* x = barrett->product;
+    if(!BigInt_digits_multiply(x, a, n, b, n, barrett->arena)) {
         return 0;
     }
-    BOOL result = BigInt_multiply(big_int, big_int_multiplier);
-    BigInt_free(big_int_multiplier);
-    return result;
+    // q = floor(floor(x / BASE^(n-1)) * mu / BASE^(n+1)) is at most two
+    // below floor(x / m), and has at most n + 1 digits
+    if(!BigInt_digits_multiply(barrett->estimate, &x[n - 1], n + 1, barrett->mu, barrett->nmu, barrett->arena)) {
+        return 0;
+    }
+    const BigInt_digit* q = &barrett->estimate[n + 1];
+    size_t nq = BigInt_digits_trim(q, MIN(barrett->nmu, n + 1));
+    if(nq) {
+        // x - q * m < 3m fits in n + 1 digits, so only those are needed
+        if(nq < BigInt_thresholds[BIGINT_THRESHOLD_KARATSUBA]) {
+            BigInt_digits_multiply_low_basecase(barrett->back, q, nq, barrett->m, n, n + 1);
+        } else if(!BigInt_digits_multiply(barrett->back, q, nq, barrett->m, n, barrett->arena)) {
+            return 0;
+        }
+        BigInt_digits_subtract(x, x, n + 1, barrett->back, n + 1);
+    }
+    while(x[n] || BigInt_digits_compare(x, n, barrett->m, n) >= 0) {
+        BigInt_digits_subtract_in_place(x, n + 1, barrett->m, n);
+    }
+    memcpy(out, x, n * sizeof(BigInt_digit));
+    return 1;
 }
 
-BOOL BigInt_divide(
-    BigInt* dividend, BigInt* divisor,
-    BigInt* quotient, BigInt* remainder)
-{
-    int result = 0; // default to failure
-    BigInt* div2 = NULL;
-    BigInt* div3 = NULL;
-    BigInt* div4 = NULL;
-    BigInt* div5 = NULL;
-    BigInt* div6 = NULL;
-    BigInt* div7 = NULL;
-    BigInt* div8 = NULL;
-    BigInt* div9 = NULL;
-    BigInt* ten = NULL;
-    BigInt* _quotient = NULL;
-    BigInt* _remainder = NULL;
+// Window widths for exponents of up to this many bits use one bit more
+// than the last.
+static const size_t BigInt_powmod_window_bits[] = {7, 25, 81, 241, 673};
 
-    if(!BigInt_compare_int(divisor, 0)) {
-        errno = ERANGE; // even BigInt can't represent infinity
-        goto cleanup;
+// Returns bit i of an exponent stored 16 bits to an element, least
+// significant first.
+static inline unsigned int BigInt_exponent_bit(const uint16_t* chunks, size_t i) {
+    return chunks[i / 16] >> (i % 16) & 1;
+}
+
+// Sliding-window exponentiation (Handbook of Applied Cryptography, 14.85)
+// from the most significant bit of the exponent: squares for each bit, and
+// one multiplication by a precomputed odd power of the base for each window
+// of up to k bits that starts and ends with a 1.  Every product is reduced
+// with BigInt_barrett_multiply into buffers set up once, so the steps don't
+// allocate.
+BOOL BigInt_powmod(BigInt* result, const BigInt* base, const BigInt* exponent, const BigInt* modulus) {
+    if(!BigInt_compare_int(modulus, 0)) {
+        errno = ERANGE;
+        return 0;
     }
-    div2 = BigInt_clone(divisor, divisor->num_digits + 1);
-    if(!div2 || !BigInt_multiply_int(div2, 2)) {
-        goto cleanup;
+    if(exponent->is_negative) {
+        errno = EINVAL;
+        return 0;
     }
-    div3 = BigInt_clone(divisor, divisor->num_digits + 1);
-    if(!div3 || !BigInt_multiply_int(div3, 3)) {
-        goto cleanup;
+    size_t n = modulus->num_digits;
+    if(n == 1 && BIGINT_DIGIT_VALUE(modulus->digits[0]) == 1) {
+        return BigInt_assign_int(result, 0);
     }
-    div4 = BigInt_clone(divisor, divisor->num_digits + 1);
-    if(!div4 || !BigInt_multiply_int(div4, 4)) {
+
+    BOOL success = 0;
+    BigInt_arena* arena = BigInt_scratch_arena();
+    BigInt_arena_mark mark = BigInt_arena_save(arena);
+    BigInt m, reduced, mu, power;
+    BOOL have_m = 0, have_reduced = 0, have_mu = 0, have_power = 0;
+
+    // copies of the magnitude of modulus and of base, so result may be any
+    // of the operands
+    have_m = BigInt_init_scratch(&m, arena, n);
+    if(!have_m) {
         goto cleanup;
     }
-    div5 = BigInt_clone(divisor, divisor->num_digits + 1);
-    if(!div5 || !BigInt_multiply_int(div5, 5)) {
+    memcpy(m.digits, modulus->digits, n * sizeof(BigInt_digit));
+    m.num_digits = n;
+    have_reduced = BigInt_init_scratch(&reduced, arena, base->num_digits);
+    if(!have_reduced) {
         goto cleanup;
     }
-    div6 = BigInt_clone(divisor, divisor->num_digits + 1);
-    if(!div6 || !BigInt_multiply_int(div6, 6)) {
+    memcpy(reduced.digits, base->digits, base->num_digits * sizeof(BigInt_digit));
+    reduced.num_digits = base->num_digits;
+    reduced.is_negative = base->is_negative;
+    if(!BigInt_divide(&reduced, &m, NULL, &reduced)) {
         goto cleanup;
     }
-    div7 = BigInt_clone(divisor, divisor->num_digits + 1);
-    if(!div7 || !BigInt_multiply_int(div7, 7)) {
+    if(reduced.is_negative && !BigInt_add(&reduced, &m)) {
         goto cleanup;
     }
-    div8 = BigInt_clone(divisor, divisor->num_digits + 1);
-    if(!div8 || !BigInt_multiply_int(div8, 8)) {
+
+    // mu = floor(BASE^2n / m)
+    have_mu = BigInt_init_scratch(&mu, arena, 2 * n + 1);
+    if(!have_mu) {
         goto cleanup;
     }
-    div9 = BigInt_clone(divisor, divisor->num_digits + 1);
-    if(!div9 || !BigInt_multiply_int(div9, 9)) {
+    memset(mu.digits, 0, 2 * n * sizeof(BigInt_digit));
+    mu.digits[2 * n] = BIGINT_DIGIT_FROM_VALUE(1);
+    mu.num_digits = 2 * n + 1;
+    if(!BigInt_divide(&mu, &m, &mu, NULL)) {
         goto cleanup;
     }
 
-    ten = BigInt_construct( 10 );
-    _quotient = BigInt_construct( 0 );
-    _remainder = BigInt_construct( 0 );
-    if(!ten || !_quotient || !_remainder) {
+    // The exponent's bits, 16 to an element; dividing by 2^16 fits every
+    // representation's BigInt_digits_divide_small.
+    size_t ne = exponent->num_digits;
+    size_t num_chunks = 0;
+    uint16_t* chunks = BigInt_arena_alloc(arena, (ne * sizeof(BigInt_digit) * 8 / 16 + 1) * sizeof(uint16_t));
+    BigInt_digit* e = BigInt_arena_alloc(arena, ne * sizeof(BigInt_digit));
+    if(!chunks || !e) {
         goto cleanup;
     }
+    memcpy(e, exponent->digits, ne * sizeof(BigInt_digit));
+    while((ne = BigInt_digits_trim(e, ne))) {
+        chunks[num_chunks++] = (uint16_t)BigInt_digits_divide_small(e, e, ne, 1 << 16);
+    }
+    size_t bits = 16 * num_chunks;
+    while(bits && !BigInt_exponent_bit(chunks, bits - 1)) {
+        bits--;
+    }
+
+    size_t window = 1;
+    while(window <= sizeof(BigInt_powmod_window_bits) / sizeof(BigInt_powmod_window_bits[0])
+            && bits > BigInt_powmod_window_bits[window - 1]) {
+        window++;
+    }
+
+    BigInt_barrett barrett;
+    barrett.m = m.digits;
+    barrett.n = n;
+    barrett.mu = mu.digits;
+    barrett.nmu = mu.num_digits;
+    barrett.arena = arena;
+    size_t table_size = (size_t)1 << (window - 1);
+    BigInt_digit* table = BigInt_arena_alloc(arena, (table_size + 1) * n * sizeof(BigInt_digit));
+    barrett.product = BigInt_arena_alloc(arena, 2 * n * sizeof(BigInt_digit));
+    barrett.estimate = BigInt_arena_alloc(arena, (n + 1 + barrett.nmu) * sizeof(BigInt_digit));
+    barrett.back = BigInt_arena_alloc(arena, (2 * n + 1) * sizeof(BigInt_digit));
+    if(!table || !barrett.product || !barrett.estimate || !barrett.back) {
+        goto cleanup;
+    }
+    BigInt_digit* acc = &table[table_size * n];
 
-    BigInt* divs[10];
-    // NOTE: divs[0] intentionally unused so that new_digit == index below
-    divs[1] = divisor;
-    divs[2] = div2;
-    divs[3] = div3;
-    divs[4] = div4;
-    divs[5] = div5;
-    divs[6] = div6;
-    divs[7] = div7;
-    divs[8] = div8;
-    divs[9] = div9;
-
-    const unsigned char* base = dividend->digits;
-    const unsigned char* digits = &base[dividend->num_digits-1];
-
-    while(digits >= base) {
-        if(!BigInt_multiply(_remainder, ten)) {
+    // table[i] = base^(2i + 1) mod m
+    memset(table, 0, n * sizeof(BigInt_digit));
+    memcpy(table, reduced.digits, reduced.num_digits * sizeof(BigInt_digit));
+    if(table_size > 1) {
+        if(!BigInt_barrett_multiply(&barrett, acc, table, table)) {
             goto cleanup;
         }
-        if(!BigInt_add_int(_remainder, *digits)) {
-            goto cleanup;
+        for(size_t i = 1; i < table_size; i++) {
+            if(!BigInt_barrett_multiply(&barrett, &table[i * n], &table[(i - 1) * n], acc)) {
+                goto cleanup;
+            }
         }
-        int new_digit = 0;
-        for(int i = 9; i >= 1; i--) {
-            if(BigInt_compare(_remainder, divs[i]) >= 0) {
-                if(!BigInt_subtract(_remainder, divs[i])) {
-                    goto cleanup;
-                }
-                new_digit = i;
-                break;
+    }
+
+    memset(acc, 0, n * sizeof(BigInt_digit));
+    acc[0] = BIGINT_DIGIT_FROM_VALUE(1);
+    BOOL started = 0;
+    size_t i = bits;
+    while(i) {
+        if(!BigInt_exponent_bit(chunks, i - 1)) {
+            if(!BigInt_barrett_multiply(&barrett, acc, acc, acc)) {
+                goto cleanup;
             }
+            i--;
+            continue;
         }
-        if(!BigInt_multiply(_quotient, ten) || !BigInt_add_int(_quotient, new_digit)) {
-            goto cleanup;
+        // the longest window below bit i that ends in a 1
+        size_t low = i > window ? i - window : 0;
+        while(!BigInt_exponent_bit(chunks, low)) {
+            low++;
         }
-        digits--;
-    }
-    
-    if(quotient) {
-        if(!BigInt_assign(quotient, _quotient)) {
-            goto cleanup;
+        size_t value = 0;
+        for(size_t j = i; j > low; j--) {
+            value = value << 1 | BigInt_exponent_bit(chunks, j - 1);
         }
-    }
-    if(remainder) {
-        if(!BigInt_assign(remainder, _remainder)) {
-            goto cleanup;
+        if(started) {
+            for(size_t j = low; j < i; j++) {
+                if(!BigInt_barrett_multiply(&barrett, acc, acc, acc)) {
+                    goto cleanup;
+                }
+            }
+            if(!BigInt_barrett_multiply(&barrett, acc, acc, &table[(value >> 1) * n])) {
+                goto cleanup;
+            }
+        } else {
+            memcpy(acc, &table[(value >> 1) * n], n * sizeof(BigInt_digit));
+            started = 1;
         }
+        i = low;
     }
-    
-    result = 1;
+
+    have_power = BigInt_init_result(&power, result, arena, n);
+    if(!have_power) {
+        goto cleanup;
+    }
+    memcpy(power.digits, acc, n * sizeof(BigInt_digit));
+    power.num_digits = n;
+    BigInt_trim(&power);
+    success = BigInt_move(result, &power);
 cleanup:
-    BigInt_free(div2);
-    BigInt_free(div3);
-    BigInt_free(div4);
-    BigInt_free(div5);
-    BigInt_free(div6);
-    BigInt_free(div7);
-    BigInt_free(div8);
-    BigInt_free(div9);
-    BigInt_free(ten);
-    BigInt_free(_remainder);
-    BigInt_free(_quotient);
-    return result;
+    if(have_power) {
+        BigInt_free_digits(&power);
+    }
+    if(have_mu) {
+        BigInt_free_digits(&mu);
+    }
+    if(have_reduced) {
+        BigInt_free_digits(&reduced);
+    }
+    if(have_m) {
+        BigInt_free_digits(&m);
+    }
+    BigInt_arena_restore(arena, mark);
+    return success;
 }
 
 BOOL BigInt_to_int(const BigInt* big_int, int* value) {
     *value = 0;
-    int tens_multiplier = 1;
 
-    unsigned int num_digits = big_int->num_digits;
-    const unsigned char* digits = big_int->digits;
-    
-    // don't process any most significant digits that happen to be zero
-    // (avoids unnecessary tens_multiplier overflow)
-    while(num_digits && !digits[num_digits-1]) {
-        num_digits--;
+    // the magnitude of a negative value may be one larger than INT_MAX
+    BigInt_double_digit limit = INT_MAX;
+    if(big_int->is_negative) {
+        limit++;
     }
 
-    // prefill value so that we can avoid an unnecessary tens_multiplier overflow
-    if(num_digits) {
-        *value = *(digits++);
-        num_digits--;
-    }
+    BigInt_double_digit magnitude = 0;
+    size_t num_digits = big_int->num_digits;
+    const BigInt_digit* digits = big_int->digits;
     while(num_digits--) {
-        int digit = *(digits++);
-        if(
-            !check_mul_int_int(tens_multiplier, 10, &tens_multiplier)
-            || !check_mul_int_int(digit, tens_multiplier, &digit)
-            || !check_add_int_int(*value, digit, value)
-        ) {
+        BigInt_double_digit digit = BIGINT_DIGIT_VALUE(digits[num_digits]);
+        if(digit > limit || magnitude > (limit - digit) / BIGINT_BASE) {
             errno = ERANGE;
             return 0;
         }
+        magnitude = magnitude * BIGINT_BASE + digit;
     }
 
-    if (big_int->is_negative) {
-        if(!check_mul_int_int(*value, -1, value)) {
-            errno = ERANGE;
-            return 0;
-        }
+    if(big_int->is_negative && magnitude) {
+        *value = -(int)(magnitude - 1) - 1;
+    } else {
+        *value = magnitude;
     }
-
     return 1;
-
 }
 
 void BigInt_print(const BigInt* big_int) {
@@ -683,40 +3759,67 @@ void BigInt_print(const BigInt* big_int) {
 }
 
 void BigInt_fprint(FILE *dest, const BigInt* big_int) {
-    const unsigned char* base = big_int->digits;
-    const unsigned char* digits = &base[big_int->num_digits-1];
-    if (big_int->is_negative) fputc('-', dest);
-    while(digits >= base) {
-        fputc('0' + *(digits--), dest);
+    size_t num_chunks;
+    BigInt_digit* allocated;
+    const BigInt_digit* chunks = BigInt_decimal_chunks(big_int, &num_chunks, &allocated);
+    if(!chunks) {
+        return;
     }
+    if (big_int->is_negative) fputc('-', dest);
+    char buf[BIGINT_CHUNK_WIDTH];
+    unsigned int width = BigInt_chunk_strlen(chunks[num_chunks-1]);
+    while(num_chunks--) {
+        BigInt_format_chunk(buf, chunks[num_chunks], width);
+        fwrite(buf, 1, width, dest);
+        width = BIGINT_CHUNK_WIDTH;
+    }
+    BigInt_free_chunks(big_int, allocated);
 }
 
-unsigned int BigInt_strlen(const BigInt* big_int){
-    unsigned int len = big_int->num_digits;
+size_t BigInt_strlen(const BigInt* big_int){
+    size_t num_chunks;
+    BigInt_digit* allocated;
+    const BigInt_digit* chunks = BigInt_decimal_chunks(big_int, &num_chunks, &allocated);
+    if(!chunks) {
+        return 0;
+    }
+    size_t len = (num_chunks - 1) * BIGINT_CHUNK_WIDTH + BigInt_chunk_strlen(chunks[num_chunks-1]);
+    BigInt_free_chunks(big_int, allocated);
     if( big_int->is_negative ){
         len++;
     }
     return len;
 }
 
-BOOL BigInt_to_string(const BigInt* big_int, char* buf, unsigned int buf_size){
-    const unsigned char* base = big_int->digits;
-    const unsigned char* digits = &base[big_int->num_digits-1];
+BOOL BigInt_to_string(const BigInt* big_int, char* buf, size_t buf_size){
+    size_t num_chunks;
+    BigInt_digit* allocated;
+    const BigInt_digit* chunks = BigInt_decimal_chunks(big_int, &num_chunks, &allocated);
+    if(!chunks) {
+        return 0;
+    }
     if (big_int->is_negative){
         if(!buf_size--){
+            BigInt_free_chunks(big_int, allocated);
             errno = ERANGE;
             return 0;
         }
         *buf++ = '-';
     }
 
-    while( digits >= base ){
-        if(!buf_size--){
+    unsigned int width = BigInt_chunk_strlen(chunks[num_chunks-1]);
+    while( num_chunks-- ){
+        if(buf_size < width){
+            BigInt_free_chunks(big_int, allocated);
             errno = ERANGE;
             return 0;
         }
-        *buf++ = '0' + *(digits--);
+        BigInt_format_chunk(buf, chunks[num_chunks], width);
+        buf += width;
+        buf_size -= width;
+        width = BIGINT_CHUNK_WIDTH;
     }
+    BigInt_free_chunks(big_int, allocated);
 
     // write 0 terminator:
     if(!buf_size--){
@@ -729,33 +3832,129 @@ BOOL BigInt_to_string(const BigInt* big_int, char* buf, unsigned int buf_size){
 }
 
 char* BigInt_to_new_string(const BigInt* big_int){
-    unsigned int buf_size = BigInt_strlen(big_int) + 1;
+    size_t len = BigInt_strlen(big_int);
+    if(!len) {
+        return NULL;
+    }
+    size_t buf_size;
+    if(!check_add_size_size(len, 1, &buf_size)) {
+        errno = ENOMEM;
+        return NULL;
+    }
     char* buf = malloc(buf_size);
     if(!buf) {
         return NULL;
     }
-    BOOL result = BigInt_to_string(big_int, buf, buf_size);
-    assert(result);
+    if(!BigInt_to_string(big_int, buf, buf_size)) {
+        free(buf);
+        return NULL;
+    }
     return buf;
 }
 
-BOOL BigInt_ensure_digits(BigInt* big_int, unsigned int digits_needed) {
-    if(big_int->num_allocated_digits < digits_needed) {
-        assert(okay_digits(big_int->digits, big_int->num_allocated_digits));
-        unsigned char* new_digits = malloc_digits(digits_needed);
+// Moves the digits of big_int into storage for num_allocated_digits digits
+// (rounded up to a whole size class when the buffer is cacheable), or into
+// the inline array if that is large enough.
+// returns non-zero on success or 0 on failure
+static BOOL BigInt_resize_digits(BigInt* big_int, size_t num_allocated_digits) {
+    assert(num_allocated_digits >= big_int->num_digits);
+    assert(okay_big_int(big_int));
+    const BigInt_allocator* allocator = big_int->allocator;
+    if(big_int->storage == BIGINT_STORAGE_FIXED_BUFFER) {
+        if(num_allocated_digits > big_int->num_allocated_digits) {
+            errno = ERANGE; // not allowed to leave the caller's buffer
+            return 0;
+        }
+        return 1;
+    }
+#if BIGINT_MAPPED
+    if(big_int->storage == BIGINT_STORAGE_MAPPED) {
+        // the value stays in its file, which only ever grows
+        if(num_allocated_digits > big_int->num_allocated_digits) {
+            return BigInt_remap_digits(big_int, num_allocated_digits);
+        }
+        return 1;
+    }
+#endif
+    if(num_allocated_digits <= BIGINT_INLINE_DIGITS) {
+        if(big_int->storage != BIGINT_STORAGE_INLINE) {
+            memcpy(big_int->inline_digits, big_int->digits, big_int->num_digits * sizeof(BigInt_digit));
+            BigInt_free_digits(big_int);
+            big_int->digits = big_int->inline_digits;
+            big_int->num_allocated_digits = BIGINT_INLINE_DIGITS;
+            big_int->storage = BIGINT_STORAGE_INLINE;
+        }
+        return 1;
+    }
+    if(!BigInt_digits_bytes(num_allocated_digits)) {
+        errno = ENOMEM;
+        return 0;
+    }
+    num_allocated_digits = BigInt_digits_capacity(num_allocated_digits);
+    BOOL shared = BigInt_digits_shared(big_int);
+    if(
+        big_int->storage == BIGINT_STORAGE_HEAP && !shared
+        && num_allocated_digits == big_int->num_allocated_digits
+    ) {
+        return 1; // same size class as before
+    }
+    BigInt_digit* new_digits;
+    if(
+        big_int->storage != BIGINT_STORAGE_HEAP || shared
+        || BigInt_digit_cache_class(BigInt_digits_bytes(num_allocated_digits))
+        || BigInt_digit_cache_class(BigInt_digits_bytes(big_int->num_allocated_digits))
+    ) {
+        new_digits = BigInt_alloc_digits(allocator, num_allocated_digits);
         if(!new_digits) {
             return 0;
         }
-        assert(okay_digits(new_digits, digits_needed));
-        unsigned int old_allocated = big_int->num_allocated_digits;
-        unsigned char* old_digits = big_int->digits;
-        memcpy(new_digits, old_digits, big_int->num_digits * sizeof(unsigned char));
-        big_int->digits = new_digits;
-        big_int->num_allocated_digits = digits_needed;
+        memcpy(new_digits, big_int->digits, big_int->num_digits * sizeof(BigInt_digit));
+        BigInt_free_digits(big_int);
+    } else {
+        char* block = allocator->realloc(allocator->context, BigInt_digits_header_of(big_int->digits),
+            BigInt_digits_bytes(big_int->num_allocated_digits),
+            BigInt_digits_bytes(num_allocated_digits));
+        if(!block) {
+            return 0;
+        }
+        new_digits = (BigInt_digit*)(block + BIGINT_DIGITS_HEADER);
+    }
+    big_int->digits = new_digits;
+    big_int->num_allocated_digits = num_allocated_digits;
+    big_int->storage = BIGINT_STORAGE_HEAP;
+    assert(okay_big_int(big_int));
+    return 1;
+}
+
+BOOL BigInt_ensure_digits(BigInt* big_int, size_t digits_needed) {
+    if(big_int->num_allocated_digits < digits_needed) {
+        size_t grown;
+        if(
+            check_mul_size_size(big_int->num_allocated_digits, BIGINT_GROWTH_PERCENT, &grown)
+            && grown / 100 > digits_needed
+        ) {
+            digits_needed = grown / 100;
+        }
+        return BigInt_resize_digits(big_int, digits_needed);
+    }
+    if(BigInt_digits_shared(big_int)) {
+        // about to be written to: take a private copy
+        return BigInt_resize_digits(big_int, big_int->num_allocated_digits);
+    }
+    return 1;
+}
 
-        free_digits(old_digits, old_allocated);
-        assert(okay_digits(big_int->digits, big_int->num_allocated_digits));
+BOOL BigInt_reserve(BigInt* big_int, size_t num_digits) {
+    if(big_int->num_allocated_digits < num_digits) {
+        return BigInt_resize_digits(big_int, num_digits);
     }
     return 1;
 }
 
+BOOL BigInt_shrink_to_fit(BigInt* big_int) {
+    if(big_int->storage != BIGINT_STORAGE_HEAP || big_int->num_allocated_digits == big_int->num_digits) {
+        return 1;
+    }
+    return BigInt_resize_digits(big_int, big_int->num_digits);
+}
+
@@ -1,6 +1,7 @@
 #ifndef BIG_INT_H
 #define BIG_INT_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifndef NULL
@@ -11,13 +12,191 @@
 #define BOOL int8_t
 #endif
 
+// BIGINT_REPR selects the internal representation of the digits array at
+// build time.  Every representation supports the full API below; only the
+// base of the elements of digits (and therefore the meaning of num_digits)
+// changes.
+//   BIGINT_REPR_DECIMAL  - one decimal digit 0-9 per unsigned char (default)
+//   BIGINT_REPR_BINARY64 - base 2^64, one uint64_t limb per element.  Decimal
+//                          conversion only happens in BigInt_from_string,
+//                          BigInt_to_string, BigInt_strlen and BigInt_fprint.
+//   BIGINT_REPR_BASE1E9  - base 10^9, nine decimal digits per uint32_t.
+//   BIGINT_REPR_BASE1E19 - base 10^19, nineteen decimal digits per uint64_t.
+//                          Like the default, both keep decimal I/O linear.
+//   BIGINT_REPR_PACKED_BCD - two decimal digits per unsigned char, packed BCD:
+//                          the low nibble holds the less significant digit.
+//                          Half the memory of the default layout.
+#define BIGINT_REPR_DECIMAL 0
+#define BIGINT_REPR_BINARY64 1
+#define BIGINT_REPR_BASE1E9 2
+#define BIGINT_REPR_BASE1E19 3
+#define BIGINT_REPR_PACKED_BCD 4
+
+#ifndef BIGINT_REPR
+#define BIGINT_REPR BIGINT_REPR_DECIMAL
+#endif//BIGINT_REPR
+
+#if BIGINT_REPR == BIGINT_REPR_DECIMAL || BIGINT_REPR == BIGINT_REPR_PACKED_BCD
+typedef unsigned char BigInt_digit;
+#elif BIGINT_REPR == BIGINT_REPR_BINARY64 || BIGINT_REPR == BIGINT_REPR_BASE1E19
+typedef uint64_t BigInt_digit;
+#elif BIGINT_REPR == BIGINT_REPR_BASE1E9
+typedef uint32_t BigInt_digit;
+#else
+#error unsupported BIGINT_REPR
+#endif
+
+// Values that fit in BIGINT_INLINE_BYTES bytes of digits are stored inside
+// the BigInt itself and only move to a separate heap buffer when they grow.
+// The default holds any 64-bit value in every representation.
+#ifndef BIGINT_INLINE_BYTES
+#define BIGINT_INLINE_BYTES 24
+#endif//BIGINT_INLINE_BYTES
+#define BIGINT_INLINE_DIGITS (BIGINT_INLINE_BYTES / sizeof(BigInt_digit))
+
+// Every allocation a BigInt makes (its header and its digits) goes through
+// one of these.  size is always passed back to realloc and free, so
+// allocators don't need to track block sizes themselves.  realloc returns
+// NULL and leaves ptr untouched on failure.
+typedef struct BigInt_allocator {
+    void* (*alloc)(void* context, size_t size);
+    void* (*realloc)(void* context, void* ptr, size_t old_size, size_t new_size);
+    void (*free)(void* context, void* ptr, size_t size);
+    void* context; // passed to each of the functions above
+} BigInt_allocator;
+
+// Where the digits of a BigInt live.
+#define BIGINT_STORAGE_INLINE 0  // the BigInt's own inline_digits array
+#define BIGINT_STORAGE_HEAP 1    // a buffer from the BigInt's allocator
+#define BIGINT_STORAGE_SCRATCH 2 // a scratch arena; never freed individually
+#define BIGINT_STORAGE_BUFFER 3 // a caller-supplied buffer; moves to the heap when outgrown
+#define BIGINT_STORAGE_FIXED_BUFFER 4 // a caller-supplied buffer it may never outgrow
+#define BIGINT_STORAGE_MAPPED 5 // a memory-mapped file; grows with the file
+
 typedef struct BigInt {
-    unsigned char* digits; // Array of digits 0-9.  Greater indices hold more significant digits.
-    unsigned int num_digits; // Number of digits actually in the number.
-    unsigned int num_allocated_digits; // digits array has space for this many digits
+    BigInt_digit* digits; // Array of digits in the base selected by BIGINT_REPR.  Greater indices hold more significant digits.
+    size_t num_digits; // Number of digits actually in the number.
+    size_t num_allocated_digits; // digits array has space for this many digits
     BOOL is_negative; // Nonzero if this BigInt is negative, zero otherwise.
+    unsigned char storage; // One of the BIGINT_STORAGE_* values; caller doesn't need to care about this.
+    const BigInt_allocator* allocator; // Allocator this BigInt and its digits came from.
+    union {
+        BigInt_digit inline_digits[BIGINT_INLINE_DIGITS]; // digits points here while the value is small
+        int mapped_fd; // file descriptor behind BIGINT_STORAGE_MAPPED digits
+    };
 } BigInt;
 
+//============================================================================
+// Allocators
+//============================================================================
+
+// The C library's malloc, realloc and free.  This is the default allocator.
+extern const BigInt_allocator BigInt_malloc_allocator;
+
+// Debug allocator that surrounds every block with redzones and checks them
+// when the block is freed.  This is the default allocator when BigInt.c is
+// built with BIGINT_REDZONE set to the redzone size in bytes.
+extern const BigInt_allocator BigInt_redzone_allocator;
+
+// Registers the allocator used by BigInts created from now on; NULL restores
+// the default.  Each BigInt keeps the allocator it was created with, so
+// allocator must stay valid until all those BigInts are freed.  Not thread
+// safe; register allocators before sharing BigInts between threads.
+void BigInt_set_allocator(const BigInt_allocator* allocator);
+
+// Returns the currently registered allocator.
+const BigInt_allocator* BigInt_get_allocator();
+
+//============================================================================
+// Scratch arenas
+//============================================================================
+
+// A bump-pointer arena that BigInt_multiply and BigInt_divide take their
+// temporaries from.  Space is handed out from a chain of blocks and given
+// back in O(1) by restoring a mark, so blocks are reused from one operation
+// to the next instead of going back to the allocator.
+typedef struct BigInt_arena {
+    struct BigInt_arena_block* head; // first block of the chain
+    struct BigInt_arena_block* current; // block being allocated from, NULL before the first
+    size_t used; // bytes used in current
+    const BigInt_allocator* allocator; // where blocks come from
+} BigInt_arena;
+
+// Each thread's built-in scratch arena and digit cache are released when
+// the thread exits, through a thread-specific data destructor on systems
+// with pthreads.  Build with BIGINT_PTHREADS set to 0 to do without; a
+// thread must then pass BigInt_scratch_arena() to BigInt_arena_destroy and
+// call BigInt_digit_cache_flush before it exits.
+#ifndef BIGINT_PTHREADS
+#if defined(__unix__) || defined(__APPLE__)
+#define BIGINT_PTHREADS 1
+#else
+#define BIGINT_PTHREADS 0
+#endif
+#endif//BIGINT_PTHREADS
+
+// A position in a BigInt_arena to return to.
+typedef struct BigInt_arena_mark {
+    struct BigInt_arena_block* block;
+    size_t used;
+} BigInt_arena_mark;
+
+// Initializes an empty arena whose blocks come from the registered allocator.
+void BigInt_arena_init(BigInt_arena* arena);
+
+// Frees all blocks of arena and leaves it empty.
+void BigInt_arena_destroy(BigInt_arena* arena);
+
+// Returns the current position of arena.
+BigInt_arena_mark BigInt_arena_save(const BigInt_arena* arena);
+
+// Releases everything allocated from arena since mark was saved.
+void BigInt_arena_restore(BigInt_arena* arena, BigInt_arena_mark mark);
+
+// Releases everything allocated from arena, keeping its blocks for reuse.
+void BigInt_arena_reset(BigInt_arena* arena);
+
+// Makes arena the scratch arena for operations on the calling thread.
+// NULL selects the thread's built-in arena again.  The arena must outlive
+// its use; operations leave it where they found it.
+void BigInt_set_scratch_arena(BigInt_arena* arena);
+
+// Returns the calling thread's scratch arena.  The blocks of the built-in
+// arena are released when the thread exits (see BIGINT_PTHREADS), or
+// earlier by passing it to BigInt_arena_destroy.
+BigInt_arena* BigInt_scratch_arena();
+
+//============================================================================
+// Digit buffer cache
+//============================================================================
+
+// Each thread keeps recently freed digits buffers, bucketed by power-of-two
+// size class, and reuses them for new digits instead of calling the
+// allocator.  The cache is bounded (see BIGINT_DIGIT_CACHE_BYTES in BigInt.c).
+// Build with BIGINT_DIGIT_CACHE set to 0 to disable it.
+#ifndef BIGINT_DIGIT_CACHE
+#define BIGINT_DIGIT_CACHE 1
+#endif//BIGINT_DIGIT_CACHE
+
+typedef struct BigInt_digit_cache_stats {
+    size_t hits; // allocations served from the cache
+    size_t misses; // cacheable allocations that went to the allocator
+    size_t cached_frees; // buffers kept in the cache when freed
+    size_t uncached_frees; // cacheable buffers freed while the cache was full
+    size_t cached_buffers; // buffers currently in the cache
+    size_t cached_bytes; // bytes currently in the cache
+} BigInt_digit_cache_stats;
+
+// Fills stats with the counters of the calling thread's cache.
+void BigInt_digit_cache_get_stats(BigInt_digit_cache_stats* stats);
+
+// Returns all buffers in the calling thread's cache to their allocators.
+// Only the calling thread's cache is flushed; other threads keep theirs
+// until they flush or exit.  Call this before destroying an allocator
+// that buffers in the cache came from.  A thread's cache is flushed when it
+// exits (see BIGINT_PTHREADS).
+void BigInt_digit_cache_flush();
+
 //============================================================================
 // Construction and assignment
 //============================================================================
@@ -29,10 +208,12 @@ typedef struct BigInt {
 BigInt* BigInt_construct(int value);
 
 // Returns a pointer to a new BigInt initialized from the supplied BigInt.
+// A heap buffer is shared with big_int until either is modified, unless
+// num_allocated_digits asks for more room than it has.
 // Caller is responsible for freeing the new BigInt with a
 // corresponding call to BigInt_free.
 // returns NULL on memory allocation failure.
-BigInt* BigInt_clone(const BigInt* big_int, unsigned int num_allocated_digits);
+BigInt* BigInt_clone(const BigInt* big_int, size_t num_allocated_digits);
 
 // Returns a pointer to a new BigInt initialized from digits in the specified
 // zero-terminated string. Caller is responsible for freeing the new BigInt
@@ -42,8 +223,35 @@ BigInt* BigInt_from_string(const char* str);
 // Frees the memory for a BigInt allocated using BigInt_construct.
 void BigInt_free(BigInt* big_int);
 
+// Policies for BigInt_init_with_buffer.
+#define BIGINT_BUFFER_FIXED 0 // operations that would outgrow the buffer fail with errno = ERANGE
+#define BIGINT_BUFFER_MAY_SPILL 1 // the value moves to the heap when it outgrows the buffer
+
+// Initializes a BigInt in caller-owned memory (stack, struct member, shared
+// memory...) to 0, keeping its digits in the caller-supplied buffer of
+// num_allocated_digits digits.  Pass a NULL buffer to use only the BigInt's
+// inline storage.  policy is one of the BIGINT_BUFFER_* values.  The BigInt
+// must not be passed to BigInt_free; release it with BigInt_release.
+void BigInt_init_with_buffer(BigInt* big_int, BigInt_digit* digits,
+        size_t num_allocated_digits, int policy);
+
+// Releases any heap digits a BigInt set up by BigInt_init_with_buffer has
+// spilled into.  Neither big_int itself nor the caller's buffer is freed.
+void BigInt_release(BigInt* big_int);
+
+// Makes room for at least num_digits digits in big_int up front, so that
+// growing to that size later doesn't reallocate.
+// returns non-zero on success or 0 on failure
+BOOL BigInt_reserve(BigInt* big_int, size_t num_digits);
+
+// Releases any digits space big_int holds beyond its current value, e.g.
+// after a temporary peak.
+// returns non-zero on success or 0 on failure
+BOOL BigInt_shrink_to_fit(BigInt* big_int);
+
 ///Sets the value of the target BigInt to the value of the source BigInt.
-// Assumes that target and source already point to valid BigInts.
+// Assumes that target and source already point to valid BigInts.  Like
+// BigInt_clone, target shares a heap buffer of source until either changes.
 // returns non-zero on success or 0 on failure
 BOOL BigInt_assign(BigInt* target, const BigInt* source);
 
@@ -51,6 +259,19 @@ BOOL BigInt_assign(BigInt* target, const BigInt* source);
 // returns non-zero on success or 0 on failure
 BOOL BigInt_assign_int(BigInt* target, const int source);
 
+// Sets target to the value of source and source to 0.  When source owns a
+// heap buffer and target isn't bound to caller-provided storage, target
+// takes over that buffer instead of copying the digits (unless the value is
+// small enough for target's inline storage).
+// returns non-zero on success or 0 on failure
+BOOL BigInt_move(BigInt* target, BigInt* source);
+
+// Exchanges the values of a and b.  Heap and inline BigInts just trade
+// buffers; a BigInt using caller-provided storage keeps its buffer and the
+// digits are copied, which can fail if that buffer is too small.
+// returns non-zero on success or 0 on failure
+BOOL BigInt_swap(BigInt* a, BigInt* b);
+
 // Prints the contents of big_int to stdout.
 void BigInt_print(const BigInt* big_int);
 
@@ -59,17 +280,112 @@ void BigInt_fprint(FILE *dest, const BigInt* big_int);
 
 // what would be the length of a string if this BigInt were converted to a string
 // (see BigInt_to_string() below)
-unsigned int BigInt_strlen(const BigInt* big_int);
+size_t BigInt_strlen(const BigInt* big_int);
 
 // write BigInt to a string buffer, returns non-zero on success
 // returns zero if BigInt doesn't fit into buf.
 // buf_size *must* include the terminating zero byte
-BOOL BigInt_to_string(const BigInt* big_int, char* buf, unsigned int buf_size);
+BOOL BigInt_to_string(const BigInt* big_int, char* buf, size_t buf_size);
 
 // convert BigInt to a newly allocated string.
 // returns NULL on failure.
 char* BigInt_to_new_string(const BigInt* big_int);
 
+//============================================================================
+// File-backed storage
+//============================================================================
+
+// A BigInt can keep its digits in a memory-mapped file, so values larger
+// than RAM are paged in and out by the kernel.  The file starts with a small
+// header recording the representation, the sign and the number of digits,
+// so the value can be mapped again later.  Growing the value grows the
+// file.  BigInts built without BIGINT_MAPPED (the default on POSIX systems)
+// fail these calls with errno = ENOSYS.
+#ifndef BIGINT_MAPPED
+#if defined(__unix__) || defined(__APPLE__)
+#define BIGINT_MAPPED 1
+#else
+#define BIGINT_MAPPED 0
+#endif
+#endif//BIGINT_MAPPED
+
+// Initializes a BigInt in caller-owned memory to the value in the file open
+// for reading and writing on fd.  An empty file is set up to hold 0.  On
+// success big_int owns fd and closes it when released with BigInt_release;
+// on failure the caller still owns fd.  Fails with errno = EINVAL if the
+// file isn't a BigInt file of this build's representation.
+// returns non-zero on success or 0 on failure
+BOOL BigInt_map_file(BigInt* big_int, int fd);
+
+// Returns a pointer to a new BigInt mapped from the file at path, which is
+// created empty (holding 0) if it doesn't exist.  Free it with BigInt_free,
+// which leaves the value in the file.
+// returns NULL on failure
+BigInt* BigInt_open_mapped(const char* path);
+
+// Records the sign and length of the mapped big_int in its file and flushes
+// the file to disk.  Releasing the BigInt records them too.
+// returns non-zero on success or 0 on failure
+BOOL BigInt_sync_mapped(BigInt* big_int);
+
+//============================================================================
+// Out-of-core multiplication
+//============================================================================
+
+typedef struct BigInt_out_of_core_stats {
+    size_t chunk_digits; // digits per operand chunk the budget allowed
+    size_t peak_bytes; // most working memory held at once
+    size_t bytes_spilled; // partial product bytes streamed through the temporary file
+} BigInt_out_of_core_stats;
+
+// Multiplies big_int by multiplier like BigInt_multiply, but holding no more
+// than memory_budget bytes of working memory on top of the operands and the
+// result, so it suits operands in file-backed storage that don't fit in
+// RAM.  The operands are processed in chunks and the finished low digits
+// of the product are streamed through a temporary file before being copied
+// into big_int.  If stats isn't NULL it receives the figures above.
+// Fails with errno = EINVAL if the budget is too small to hold even
+// single-digit chunks.
+// returns non-zero on success or 0 on failure
+BOOL BigInt_multiply_out_of_core(BigInt* big_int, const BigInt* multiplier,
+        size_t memory_budget, BigInt_out_of_core_stats* stats);
+
+//============================================================================
+// Multiplication algorithms
+//============================================================================
+
+// BigInt_multiply picks its algorithm by the length of the shorter operand,
+// counted in elements of digits.  These select the size at which each
+// faster algorithm takes over.
+#define BIGINT_THRESHOLD_KARATSUBA 0 // Karatsuba instead of pencil and paper
+#define BIGINT_THRESHOLD_TOOM3 1     // Toom-3 instead of Karatsuba
+#define BIGINT_THRESHOLD_TOOM4 2     // Toom-4 instead of Toom-3
+#define BIGINT_THRESHOLD_NTT 3       // number theoretic transform, see BIGINT_NTT
+// BigInt_divide switches from long division to Burnikel-Ziegler recursive
+// division once both the divisor and the quotient are this long.
+#define BIGINT_THRESHOLD_DIVIDE 4
+#define BIGINT_THRESHOLD_COUNT 5
+
+// The number theoretic transform needs unsigned __int128.  Without it, or
+// built with BIGINT_NTT set to 0, Toom-4 is used however large the operands.
+#ifndef BIGINT_NTT
+#if defined(__SIZEOF_INT128__)
+#define BIGINT_NTT 1
+#else
+#define BIGINT_NTT 0
+#endif
+#endif//BIGINT_NTT
+
+// Sets a threshold to num_digits, or back to its default if num_digits is
+// 0.  Values below the smallest operands an algorithm can split (2 digits
+// for Karatsuba, 16 for Toom-Cook, 4 for division) are raised to that.  Not
+// thread safe; set thresholds before multiplying on several threads.
+// returns non-zero on success or 0 (errno = EINVAL) for an unknown threshold
+BOOL BigInt_set_threshold(int threshold, size_t num_digits);
+
+// Returns the current value of a threshold, or 0 for an unknown one.
+size_t BigInt_get_threshold(int threshold);
+
 //============================================================================
 // Basic mathematical operations
 //============================================================================
@@ -97,7 +413,14 @@ BOOL BigInt_subtract_int(BigInt* big_int, const int to_subtract);
 BOOL BigInt_multiply(BigInt* big_int, const BigInt* multiplier);
 BOOL BigInt_multiply_int(BigInt* big_int, const int multiplier);
 
-// Divides dividend by divisor.
+// Squares the value in big_int, in about half the digit products of a
+// general multiplication for small values and with cheaper steps at every
+// size.  BigInt_multiply(x, x) does the same.
+// returns non-zero on success or 0 on failure
+BOOL BigInt_square(BigInt* big_int);
+
+// Divides dividend by divisor.  The quotient is truncated toward zero and
+// the remainder takes the sign of dividend, as with C's / and %.
 // If only quotient is desired, remainder can be NULL
 // If only remainder is desired, quotient can be NULL
 // if both quotient and remainder are NULL, this is just a fancy way of burning cpu
@@ -107,6 +430,39 @@ BOOL BigInt_divide(
     BigInt* quotient, BigInt* remainder
 );
 
+// Divides big_int by divisor in place in a single pass over its digits,
+// without allocating.  The quotient is truncated toward zero and the
+// remainder, stored in *remainder unless that is NULL, takes the sign of
+// big_int, as with BigInt_divide.
+// returns non-zero on success or 0 on failure (errno = ERANGE if divisor is 0)
+BOOL BigInt_divide_int(BigInt* big_int, const int divisor, int* remainder);
+
+// Stores the remainder of big_int divided by divisor in *remainder, with
+// the sign of big_int, leaving big_int unchanged.  remainder can be NULL,
+// in which case this only checks divisor.
+// returns non-zero on success or 0 on failure (errno = ERANGE if divisor is 0)
+BOOL BigInt_mod_int(const BigInt* big_int, const int divisor, int* remainder);
+
+// Divides big_int in place by divisor, which must divide it exactly (debug
+// builds assert that it does; otherwise big_int is left with an unspecified
+// value).  This works up from the least significant digit and never needs a
+// remainder, so it is several times faster than BigInt_divide, for e.g.
+// binomial coefficients or reducing fractions.
+// Once both the divisor and the quotient reach BIGINT_THRESHOLD_DIVIDE
+// digits it uses BigInt_divide's recursive division instead.
+// returns non-zero on success or 0 on failure (errno = ERANGE if divisor is 0)
+BOOL BigInt_divexact(BigInt* big_int, const BigInt* divisor);
+BOOL BigInt_divexact_int(BigInt* big_int, const int divisor);
+
+// Sets result to base raised to the power exponent, modulo the magnitude of
+// modulus, as a value from 0 up to it.  Squarings and multiplications are
+// reduced by Barrett's method, with a sliding window over the exponent's
+// bits; the buffers are set up once and reused by every step.  result may
+// be any of the operands.
+// returns non-zero on success or 0 on failure (errno = ERANGE if modulus
+// is 0, EINVAL if exponent is negative)
+BOOL BigInt_powmod(BigInt* result, const BigInt* base, const BigInt* exponent, const BigInt* modulus);
+
 // Sets result to the value of big_int as an integer if the
 // value of big_int fits within the size of result's type on the target
 // environment.  returns non-zero on success or 0 on failure.
@@ -118,8 +474,9 @@ BOOL BigInt_to_int(const BigInt* big_int, int* result);
 //============================================================================
 
 // Ensure that big_int has space allocated for at least digits_needed digits.
+// Grows geometrically (see BIGINT_GROWTH_PERCENT), so it may allocate more.
 // returns non-zero on success or 0 on failure
-BOOL BigInt_ensure_digits(BigInt* big_int, unsigned int digits_needed);
+BOOL BigInt_ensure_digits(BigInt* big_int, size_t digits_needed);
 
 // Performs an unsigned comparison of the two BigInt parameters; that is, the
 // comparison is of their absolute values.  Returns 1 if |a| > |b|, 0 if |a| == |b|,
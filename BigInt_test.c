@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h> // strerror
@@ -7,6 +8,15 @@
 #include "BigInt.h"
 #include "BigInt_test.h"
 
+#if BIGINT_PTHREADS
+#include <pthread.h>
+#endif
+
+#if BIGINT_MAPPED
+#include <fcntl.h> // open
+#include <unistd.h> // unlink
+#endif
+
 const char* OPERATION_NAMES[] = {"Addition", "Addition with int",
         "Subtraction", "Subtraction with int", "Multiplication",
         "Multiplication with int", "Comparison"};
@@ -49,6 +59,46 @@ void BigInt_test_basic() {
     assert(BigInt_to_int(big_int, &value) && value == 42);
     assert(BigInt_ensure_digits(big_int, 1));
     assert(BigInt_to_int(big_int, &value) && value == 42);
+
+    // growth is geometric, so growing one digit at a time rarely reallocates
+    size_t allocated = big_int->num_allocated_digits;
+    assert(BigInt_ensure_digits(big_int, allocated + 1));
+    assert(big_int->num_allocated_digits > allocated + 1);
+
+    assert(BigInt_shrink_to_fit(big_int));
+    assert(BigInt_to_int(big_int, &value) && value == 42);
+    assert(big_int->digits == big_int->inline_digits);
+    assert(BigInt_reserve(big_int, 5000));
+    assert(big_int->num_allocated_digits >= 5000);
+    assert(BigInt_to_int(big_int, &value) && value == 42);
+
+    // sizes that would overflow a size_t are refused, not wrapped around
+    assert(!BigInt_reserve(big_int, SIZE_MAX));
+    assert(errno == ENOMEM);
+    BigInt huge;
+    BigInt_init_with_buffer(&huge, NULL, 0, BIGINT_BUFFER_FIXED);
+    huge.num_digits = SIZE_MAX; // never read: the length check comes first
+    errno = 0;
+    assert(!BigInt_add(big_int, &huge));
+    assert(errno == ENOMEM);
+    errno = 0;
+    assert(!BigInt_multiply(big_int, &huge));
+    assert(errno == ENOMEM);
+    assert(BigInt_to_int(big_int, &value) && value == 42);
+    BigInt_free(big_int);
+
+    big_int = BigInt_from_string("123456789012345678901234567890123456789012345678901234567890");
+    assert(big_int);
+    for(int i = 0; i < 200; i++) {
+        assert(BigInt_multiply_int(big_int, 1000));
+    }
+    assert(BigInt_shrink_to_fit(big_int));
+    // heap buffers are allocated in whole power-of-two size classes
+    assert(big_int->num_allocated_digits < 2 * big_int->num_digits);
+    char* str = BigInt_to_new_string(big_int);
+    assert(str);
+    assert(strlen(str) == 660 && !strncmp(str, "1234567890123", 13));
+    free(str);
     BigInt_free(big_int);
 
     // Test addition, subtraction, and comparison for all positive and
@@ -82,6 +132,66 @@ void BigInt_test_basic() {
     
     BigInt_test_signs();
     BigInt_test_multiply_optimized();
+
+    if(BIGINT_TEST_LOGGING > 0) {
+        printf("Testing inline storage\n");
+    }
+    BigInt_test_inline_storage();
+
+    if(BIGINT_TEST_LOGGING > 0) {
+        printf("Testing allocators\n");
+    }
+    BigInt_test_allocator();
+
+    if(BIGINT_TEST_LOGGING > 0) {
+        printf("Testing scratch arenas\n");
+    }
+    BigInt_test_scratch_arena();
+
+    if(BIGINT_TEST_LOGGING > 0) {
+        printf("Testing digit cache\n");
+    }
+    BigInt_test_digit_cache();
+
+    if(BIGINT_TEST_LOGGING > 0) {
+        printf("Testing caller-provided storage\n");
+    }
+    BigInt_test_caller_storage();
+
+    if(BIGINT_TEST_LOGGING > 0) {
+        printf("Testing move and swap\n");
+    }
+    BigInt_test_move_swap();
+
+    if(BIGINT_TEST_LOGGING > 0) {
+        printf("Testing copy-on-write\n");
+    }
+    BigInt_test_copy_on_write();
+
+    if(BIGINT_TEST_LOGGING > 0) {
+        printf("Testing file-backed storage\n");
+    }
+    BigInt_test_mapped();
+
+    if(BIGINT_TEST_LOGGING > 0) {
+        printf("Testing out-of-core multiplication\n");
+    }
+    BigInt_test_out_of_core();
+
+    if(BIGINT_TEST_LOGGING > 0) {
+        printf("Testing multiplication algorithms\n");
+    }
+    BigInt_test_multiply_algorithms();
+
+    if(BIGINT_TEST_LOGGING > 0) {
+        printf("Testing int operations\n");
+    }
+    BigInt_test_int_operations();
+
+    if(BIGINT_TEST_LOGGING > 0) {
+        printf("Testing modular exponentiation\n");
+    }
+    BigInt_test_powmod();
 }
 
 // This is basically a stress-test for multiplication.
@@ -126,6 +236,18 @@ void BigInt_test_signs() {
     //printf("%s\n", s);
     assert(!strcmp(s, "0"));
     free(s);
+
+    // a product of zero and a negative value is zero, not negative zero
+    static const char* negatives[] = {"-5", "-123456789012345678901234567890123456789012345678901234567890"};
+    for(unsigned int i = 0; i < sizeof(negatives) / sizeof(negatives[0]); i++) {
+        BigInt* negative = BigInt_from_string(negatives[i]);
+        assert(negative);
+        assert(BigInt_multiply(b, negative));
+        assert(BigInt_compare_int(b, 0) == 0 && !b->is_negative);
+        assert(BigInt_multiply(negative, a));
+        assert(BigInt_compare_int(negative, 0) == 0 && !negative->is_negative);
+        BigInt_free(negative);
+    }
     BigInt_free(a);
     BigInt_free(b);
 }
@@ -146,6 +268,859 @@ void BigInt_test_multiply_optimized() {
     BigInt_free(b);
 }
 
+void BigInt_test_inline_storage() {
+    // small values live inside the BigInt itself
+    BigInt* big_int = BigInt_construct(42);
+    assert(big_int);
+    assert(big_int->digits == big_int->inline_digits);
+    assert(BigInt_add_int(big_int, 2147483647));
+    assert(BigInt_multiply_int(big_int, 2147483647));
+    assert(big_int->digits == big_int->inline_digits);
+
+    // and move to the heap once they outgrow it
+    BigInt* multiplier = BigInt_from_string("123456789012345678901234567890123456789012345678901234567890");
+    assert(multiplier);
+    assert(multiplier->digits != multiplier->inline_digits);
+    assert(BigInt_multiply(big_int, multiplier));
+    assert(big_int->digits != big_int->inline_digits);
+    char* str = BigInt_to_new_string(big_int);
+    assert(str);
+    assert(!strcmp(str, "569343958373031955544305982554430598255443059825544305982553861254297070027870"));
+    free(str);
+
+    BigInt* clone = BigInt_clone(multiplier, 0);
+    assert(clone);
+    assert(BigInt_compare(clone, multiplier) == 0);
+    assert(BigInt_assign_int(clone, -7));
+    assert(BigInt_compare_int(clone, -7) == 0);
+
+    BigInt_free(big_int);
+    BigInt_free(multiplier);
+    BigInt_free(clone);
+}
+
+// Allocator for BigInt_test_allocator that counts what is outstanding.
+typedef struct Tracking_allocator_stats {
+    size_t blocks;
+    size_t bytes;
+    size_t total_blocks;
+    size_t largest_block;
+} Tracking_allocator_stats;
+
+static void* tracking_alloc(void* context, size_t size) {
+    Tracking_allocator_stats* stats = context;
+    void* p = malloc(size);
+    if(p) {
+        stats->blocks++;
+        stats->bytes += size;
+        stats->total_blocks++;
+        if(size > stats->largest_block) {
+            stats->largest_block = size;
+        }
+    }
+    return p;
+}
+
+static void* tracking_realloc(void* context, void* ptr, size_t old_size, size_t new_size) {
+    Tracking_allocator_stats* stats = context;
+    void* p = realloc(ptr, new_size);
+    if(p) {
+        stats->bytes += new_size - old_size;
+    }
+    return p;
+}
+
+static void tracking_free(void* context, void* ptr, size_t size) {
+    Tracking_allocator_stats* stats = context;
+    if(ptr) {
+        stats->blocks--;
+        stats->bytes -= size;
+    }
+    free(ptr);
+}
+
+static void allocator_workload() {
+    BigInt* a = BigInt_from_string("123456789012345678901234567890123456789012345678901234567890");
+    assert(a);
+    BigInt* b = BigInt_clone(a, 0);
+    assert(b);
+    assert(BigInt_multiply(a, b));
+    assert(BigInt_add(a, b));
+    BigInt* q = BigInt_construct(0);
+    assert(q);
+    assert(BigInt_divide(a, b, q, NULL));
+    char* str = BigInt_to_new_string(q);
+    assert(str);
+    assert(!strcmp(str, "123456789012345678901234567890123456789012345678901234567891"));
+    free(str);
+    BigInt_free(a);
+    BigInt_free(b);
+    BigInt_free(q);
+}
+
+void BigInt_test_allocator() {
+    Tracking_allocator_stats stats = {0, 0, 0, 0};
+    BigInt_allocator tracking = { tracking_alloc, tracking_realloc, tracking_free, &stats };
+
+    // the thread's scratch arena takes its blocks from the allocator that was
+    // registered when it started; start it afresh on the default one so its
+    // blocks don't show up below
+    BigInt_arena_destroy(BigInt_scratch_arena());
+
+    const BigInt_allocator* previous = BigInt_get_allocator();
+    BigInt_set_allocator(&tracking);
+    assert(BigInt_get_allocator() == &tracking);
+
+    // a BigInt keeps the allocator it was created with
+    BigInt* big_int = BigInt_construct(1);
+    assert(big_int && big_int->allocator == &tracking);
+    BigInt_set_allocator(NULL);
+    assert(BigInt_multiply_int(big_int, 1000000000));
+    assert(BigInt_multiply_int(big_int, 1000000000));
+    assert(BigInt_multiply_int(big_int, 1000000000));
+    BigInt_set_allocator(&tracking);
+    allocator_workload();
+    BigInt_free(big_int);
+
+    // freed digits may be parked in the digit cache until it is flushed
+    BigInt_digit_cache_flush();
+    assert(stats.total_blocks > 0);
+    assert(stats.blocks == 0 && stats.bytes == 0);
+
+    // the redzone checker is just another allocator
+    BigInt_set_allocator(&BigInt_redzone_allocator);
+    allocator_workload();
+    BigInt_digit_cache_flush();
+
+    BigInt_set_allocator(previous);
+}
+
+void BigInt_test_digit_cache() {
+#if BIGINT_DIGIT_CACHE
+    BigInt_digit_cache_flush();
+    BigInt_digit_cache_stats before, after;
+    BigInt_digit_cache_get_stats(&before);
+    assert(before.cached_buffers == 0 && before.cached_bytes == 0);
+
+    // a freed buffer is reused by the next allocation of its size class
+    BigInt* a = BigInt_from_string("123456789012345678901234567890123456789012345678901234567890");
+    assert(a);
+    BigInt_free(a);
+    BigInt_digit_cache_get_stats(&after);
+    assert(after.cached_buffers == 1 && after.cached_bytes > 0);
+    assert(after.cached_frees == before.cached_frees + 1);
+
+    BigInt* b = BigInt_from_string("987654321098765432109876543210987654321098765432109876543210");
+    assert(b);
+    BigInt_digit_cache_get_stats(&after);
+    assert(after.hits == before.hits + 1);
+    assert(after.cached_buffers == 0);
+
+    // short-lived values in a loop stop missing once the cache has warmed up
+    for(int i = 0; i < 1000; i++) {
+        BigInt* c = BigInt_clone(b, 0);
+        assert(c);
+        assert(BigInt_multiply(c, b));
+        BigInt_free(c);
+    }
+    BigInt_digit_cache_stats warm;
+    BigInt_digit_cache_get_stats(&warm);
+    for(int i = 0; i < 1000; i++) {
+        BigInt* c = BigInt_clone(b, 0);
+        assert(c);
+        assert(BigInt_multiply(c, b));
+        BigInt_free(c);
+    }
+    BigInt_digit_cache_get_stats(&after);
+    assert(after.misses == warm.misses);
+    assert(after.hits > warm.hits);
+
+    BigInt_free(b);
+    BigInt_digit_cache_flush();
+    BigInt_digit_cache_get_stats(&after);
+    assert(after.cached_buffers == 0 && after.cached_bytes == 0);
+
+    // an allocator whose context changes doesn't get the old context's
+    // buffers back
+    Tracking_allocator_stats first = {0, 0, 0, 0}, second = {0, 0, 0, 0};
+    BigInt_allocator tracking = { tracking_alloc, tracking_realloc, tracking_free, &first };
+    BigInt_set_allocator(&tracking);
+    a = BigInt_from_string("123456789012345678901234567890123456789012345678901234567890");
+    assert(a);
+    BigInt_free(a);
+    tracking.context = &second;
+    b = BigInt_from_string("123456789012345678901234567890123456789012345678901234567890");
+    assert(b);
+    BigInt_free(b);
+    BigInt_set_allocator(NULL);
+    BigInt_digit_cache_flush();
+    assert(first.total_blocks > 0 && second.total_blocks > 0);
+    assert(first.blocks == 0 && first.bytes == 0);
+    assert(second.blocks == 0 && second.bytes == 0);
+#endif//BIGINT_DIGIT_CACHE
+}
+
+#if BIGINT_PTHREADS
+// Runs allocator_workload on a thread of its own, which exits without
+// destroying its scratch arena or flushing its digit cache.
+static void* scratch_arena_thread(void* unused) {
+    (void)unused;
+    allocator_workload();
+    return NULL;
+}
+#endif
+
+void BigInt_test_scratch_arena() {
+    Tracking_allocator_stats stats = {0, 0, 0, 0};
+    BigInt_allocator tracking = { tracking_alloc, tracking_realloc, tracking_free, &stats };
+
+    BigInt_arena arena;
+    BigInt_arena_init(&arena);
+    BigInt_set_scratch_arena(&arena);
+    assert(BigInt_scratch_arena() == &arena);
+
+    BigInt* a = BigInt_from_string("98765432109876543210987654321098765432109876543210");
+    BigInt* b = BigInt_from_string("12345678901234567890123456789");
+    BigInt* product = BigInt_clone(a, 200);
+    BigInt* quotient = BigInt_construct(0);
+    BigInt* remainder = BigInt_construct(0);
+    assert(a && b && product && quotient && remainder);
+    assert(BigInt_reserve(quotient, 200) && BigInt_reserve(remainder, 200));
+
+    // temporaries come from the arena, which is left where it was found
+    assert(BigInt_multiply(product, b));
+    assert(BigInt_divide(product, a, quotient, remainder));
+    assert(arena.head && !arena.current && !arena.used);
+    assert(BigInt_compare(quotient, b) == 0 && BigInt_compare_int(remainder, 0) == 0);
+
+    // once the arena has warmed up, multiply and divide don't allocate at all
+    BigInt_set_allocator(&tracking);
+    assert(BigInt_assign(product, a));
+    assert(BigInt_multiply(product, b));
+    assert(BigInt_divide(product, b, quotient, remainder));
+    BigInt_set_allocator(NULL);
+    assert(stats.total_blocks == 0);
+    assert(BigInt_compare(quotient, a) == 0 && BigInt_compare_int(remainder, 0) == 0);
+
+    BigInt_set_scratch_arena(NULL);
+    assert(BigInt_scratch_arena() != &arena);
+    BigInt_arena_destroy(&arena);
+    assert(!arena.head);
+
+    BigInt_free(a);
+    BigInt_free(b);
+    BigInt_free(product);
+    BigInt_free(quotient);
+    BigInt_free(remainder);
+
+#if BIGINT_PTHREADS
+    // a thread's built-in arena and digit cache are released when the
+    // thread exits
+    stats.total_blocks = 0;
+    BigInt_set_allocator(&tracking);
+    pthread_t thread;
+    assert(!pthread_create(&thread, NULL, scratch_arena_thread, NULL));
+    assert(!pthread_join(thread, NULL));
+    BigInt_set_allocator(NULL);
+    assert(stats.total_blocks > 0);
+    assert(stats.blocks == 0 && stats.bytes == 0);
+#endif
+}
+
+void BigInt_test_caller_storage() {
+    Tracking_allocator_stats stats = {0, 0, 0, 0};
+    BigInt_allocator tracking = { tracking_alloc, tracking_realloc, tracking_free, &stats };
+    BigInt_set_allocator(&tracking);
+
+    // factorials in a fixed 40 digit buffer (in every representation) on the
+    // stack never touch the heap, and fail cleanly once they don't fit
+    BigInt_digit buffer[40];
+    BigInt factorial;
+    BigInt_init_with_buffer(&factorial, buffer, 40, BIGINT_BUFFER_FIXED);
+    assert(factorial.digits == buffer);
+    assert(BigInt_compare_int(&factorial, 0) == 0);
+    assert(BigInt_add_int(&factorial, 1));
+    int n = 1;
+    errno = 0;
+    while(BigInt_multiply_int(&factorial, n + 1)) {
+        n++;
+    }
+    assert(errno == ERANGE);
+    assert(n >= 34);
+    assert(factorial.digits == buffer);
+    BigInt_release(&factorial);
+    assert(stats.total_blocks == 0);
+
+    // adding an int that carries out of a full fixed buffer fails and leaves
+    // the value alone: BASE^3 - 1 is three of the largest digit
+    BigInt_digit power_digits[4] = {0, 0, 0, 1};
+    BigInt power;
+    BigInt_init_with_buffer(&power, power_digits, 4, BIGINT_BUFFER_FIXED);
+    power.num_digits = 4;
+    assert(BigInt_subtract_int(&power, 1) && power.num_digits == 3);
+    BigInt full;
+    BigInt_init_with_buffer(&full, buffer, 3, BIGINT_BUFFER_FIXED);
+    assert(BigInt_assign(&full, &power));
+    errno = 0;
+    assert(!BigInt_add_int(&full, 1));
+    assert(errno == ERANGE);
+    assert(BigInt_compare(&full, &power) == 0 && full.num_digits == 3);
+    assert(BigInt_multiply_int(&full, -1));
+    assert(!BigInt_subtract_int(&full, 1));
+    assert(BigInt_multiply_int(&full, -1));
+    assert(BigInt_compare(&full, &power) == 0);
+    // zero keeps its sign when what is added doesn't fit
+    BigInt_init_with_buffer(&full, buffer, 1, BIGINT_BUFFER_FIXED);
+    if(!BigInt_add_int(&full, -2147483647)) {
+        assert(BigInt_compare_int(&full, 0) == 0 && !full.is_negative);
+    }
+    BigInt_release(&full);
+    BigInt_release(&power);
+
+    // a BigInt with only its inline storage
+    BigInt small;
+    BigInt_init_with_buffer(&small, NULL, 0, BIGINT_BUFFER_FIXED);
+    assert(BigInt_assign_int(&small, 2147483647));
+    assert(BigInt_multiply_int(&small, 2147483647));
+    assert(stats.total_blocks == 0);
+    BigInt_release(&small);
+
+    // with BIGINT_BUFFER_MAY_SPILL the value moves to the heap instead
+    BigInt_digit small_buffer[2];
+    BigInt spilling;
+    BigInt_init_with_buffer(&spilling, small_buffer, 2, BIGINT_BUFFER_MAY_SPILL);
+    assert(BigInt_add_int(&spilling, 1));
+    for(int i = 2; i <= 50; i++) {
+        assert(BigInt_multiply_int(&spilling, i));
+    }
+    assert(spilling.digits != small_buffer);
+    char* str = BigInt_to_new_string(&spilling);
+    assert(str);
+    assert(!strcmp(str, "30414093201713378043612608166064768844377641568960512000000000000"));
+    free(str);
+    BigInt_release(&spilling);
+    BigInt_digit_cache_flush();
+    assert(stats.total_blocks > 0 && stats.blocks == 0);
+
+    BigInt_set_allocator(NULL);
+}
+
+void BigInt_test_move_swap() {
+    const char* big = "123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890";
+    char* str;
+
+    // moving a heap value hands over the buffer and leaves 0 behind
+    BigInt* source = BigInt_from_string(big);
+    BigInt* target = BigInt_construct(7);
+    assert(source && target);
+    BigInt_digit* digits = source->digits;
+    assert(BigInt_move(target, source));
+    assert(target->digits == digits);
+    assert(BigInt_compare_int(source, 0) == 0);
+    str = BigInt_to_new_string(target);
+    assert(str && !strcmp(str, big));
+    free(str);
+
+    // swapping heap and inline values trades the heap buffer
+    assert(BigInt_assign_int(source, -42));
+    assert(BigInt_swap(source, target));
+    assert(source->digits == digits);
+    assert(target->digits == target->inline_digits);
+    assert(BigInt_compare_int(target, -42) == 0);
+    str = BigInt_to_new_string(source);
+    assert(str && !strcmp(str, big));
+    free(str);
+
+    // a caller's buffer keeps its place; the digits are copied instead
+    BigInt_digit buffer[100];
+    BigInt fixed;
+    BigInt_init_with_buffer(&fixed, buffer, 100, BIGINT_BUFFER_FIXED);
+    assert(BigInt_swap(&fixed, source));
+    assert(fixed.digits == buffer);
+    assert(BigInt_compare_int(source, 0) == 0);
+    str = BigInt_to_new_string(&fixed);
+    assert(str && !strcmp(str, big));
+    free(str);
+    assert(BigInt_move(target, &fixed));
+    assert(fixed.digits == buffer);
+    assert(BigInt_compare_int(&fixed, 0) == 0);
+    assert(BigInt_compare(target, source) > 0);
+    BigInt_release(&fixed);
+
+    // products and quotients are handed over rather than copied back
+    BigInt* divisor = BigInt_clone(target, 0);
+    assert(divisor);
+    assert(BigInt_multiply(target, target));
+    assert(BigInt_divide(target, divisor, source, target));
+    assert(BigInt_compare_int(target, 0) == 0);
+    assert(BigInt_compare(source, divisor) == 0);
+
+    BigInt_free(source);
+    BigInt_free(target);
+    BigInt_free(divisor);
+
+    // BigInts from different allocators exchange values, never buffers
+    Tracking_allocator_stats stats = {0, 0, 0, 0};
+    BigInt_allocator tracking = { tracking_alloc, tracking_realloc, tracking_free, &stats };
+    BigInt_set_allocator(&tracking);
+    BigInt* tracked = BigInt_from_string(big);
+    BigInt_set_allocator(NULL);
+    BigInt* untracked = BigInt_from_string(big);
+    assert(tracked && untracked);
+    assert(BigInt_multiply_int(untracked, 2));
+    assert(BigInt_swap(tracked, untracked));
+    assert(BigInt_move(untracked, tracked));
+    assert(BigInt_compare_int(tracked, 0) == 0);
+    assert(BigInt_strlen(untracked) == strlen(big));
+    BigInt_free(tracked);
+    BigInt_free(untracked);
+    BigInt_digit_cache_flush();
+    assert(stats.blocks == 0);
+}
+
+void BigInt_test_copy_on_write() {
+    const char* big = "123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890";
+    Tracking_allocator_stats stats = {0, 0, 0, 0};
+    BigInt_allocator tracking = { tracking_alloc, tracking_realloc, tracking_free, &stats };
+    BigInt_set_allocator(&tracking);
+
+    // clones and assignments share the original's digits...
+    BigInt* original = BigInt_from_string(big);
+    assert(original);
+    size_t blocks = stats.blocks;
+    BigInt* clone = BigInt_clone(original, 0);
+    BigInt* assigned = BigInt_construct(1);
+    assert(clone && assigned);
+    assert(BigInt_assign(assigned, original));
+    assert(clone->digits == original->digits);
+    assert(assigned->digits == original->digits);
+    assert(stats.blocks == blocks + 2); // just the two headers
+
+    // ...until one of them is written to
+    assert(BigInt_add_int(clone, 1));
+    assert(clone->digits != original->digits);
+    assert(BigInt_compare(clone, original) > 0);
+    assert(BigInt_multiply_int(original, -2));
+    assert(original->digits != assigned->digits);
+    assert(BigInt_compare(assigned, original) > 0);
+
+    // a share outlives the BigInt it was taken from
+    BigInt_free(original);
+    char* str = BigInt_to_new_string(assigned);
+    assert(str && !strcmp(str, big));
+    free(str);
+
+    // asking for more room than the original has takes a copy straight away
+    BigInt* roomy = BigInt_clone(assigned, 2 * assigned->num_allocated_digits);
+    assert(roomy && roomy->digits != assigned->digits);
+    assert(BigInt_compare(roomy, assigned) == 0);
+
+    BigInt_free(clone);
+    BigInt_free(assigned);
+    BigInt_free(roomy);
+    BigInt_digit_cache_flush();
+    assert(stats.blocks == 0);
+
+    BigInt_set_allocator(NULL);
+}
+
+void BigInt_test_mapped() {
+#if BIGINT_MAPPED
+    char path[] = "/tmp/BigInt_test_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    BigInt mapped;
+    assert(BigInt_map_file(&mapped, fd));
+    assert(BigInt_compare_int(&mapped, 0) == 0);
+
+    // 2^32768 outgrows the initial file in every representation
+    assert(BigInt_add_int(&mapped, 2));
+    size_t allocated = mapped.num_allocated_digits;
+    for(int i = 0; i < 15; i++) {
+        assert(BigInt_multiply(&mapped, &mapped));
+    }
+    assert(mapped.num_allocated_digits > allocated);
+    assert(BigInt_strlen(&mapped) == 9865);
+    char* str = BigInt_to_new_string(&mapped);
+    assert(str);
+    assert(!strncmp(str, "14154610310449547890", 20) && !strcmp(str + 9855, "3712377856"));
+    assert(BigInt_sync_mapped(&mapped));
+    BigInt_release(&mapped);
+
+    // the value is still there when the file is mapped again
+    BigInt* reopened = BigInt_open_mapped(path);
+    assert(reopened);
+    char* str2 = BigInt_to_new_string(reopened);
+    assert(str2 && !strcmp(str, str2));
+    free(str2);
+    assert(BigInt_subtract_int(reopened, 1));
+    assert(BigInt_multiply_int(reopened, -1));
+    BigInt_free(reopened);
+    reopened = BigInt_open_mapped(path);
+    assert(reopened);
+    assert(reopened->is_negative);
+    assert(BigInt_subtract_int(reopened, 1));
+    assert(BigInt_multiply_int(reopened, -1));
+    str2 = BigInt_to_new_string(reopened);
+    assert(str2 && !strcmp(str, str2));
+    free(str2);
+    BigInt_free(reopened);
+    free(str);
+
+    // files that don't hold a BigInt are refused
+    FILE* file = fopen(path, "w");
+    assert(file);
+    fputs("not a BigInt, just some text that is long enough to have a header", file);
+    fclose(file);
+    errno = 0;
+    assert(!BigInt_open_mapped(path));
+    assert(errno == EINVAL);
+    assert(!BigInt_sync_mapped(&mapped));
+
+    // an empty file that can't be mapped is left empty
+    file = fopen(path, "w");
+    assert(file);
+    fclose(file);
+    fd = open(path, O_WRONLY);
+    assert(fd >= 0);
+    assert(!BigInt_map_file(&mapped, fd));
+    assert(lseek(fd, 0, SEEK_END) == 0);
+    close(fd);
+    unlink(path);
+#endif
+}
+
+void BigInt_test_out_of_core() {
+    // operands a few thousand digits long, multiplied a few hundred bytes at a time
+    BigInt* a = BigInt_from_string("-98765432109876543210");
+    BigInt* b = BigInt_from_string("12345678901234567890123");
+    assert(a && b);
+    for(int i = 0; i < 6; i++) {
+        assert(BigInt_multiply(a, a));
+        assert(BigInt_add_int(a, i));
+        assert(BigInt_multiply(b, b));
+        assert(BigInt_subtract_int(b, i));
+    }
+    assert(BigInt_multiply(b, b)); // twice as long as a
+
+    BigInt* expected = BigInt_clone(a, 0);
+    BigInt* product = BigInt_clone(a, 0);
+    assert(expected && product);
+    assert(BigInt_multiply(expected, b));
+    BigInt_out_of_core_stats stats;
+    assert(BigInt_multiply_out_of_core(product, b, 512, &stats));
+    assert(BigInt_compare(product, expected) == 0);
+    assert(stats.peak_bytes <= 512);
+    assert(stats.chunk_digits < b->num_digits / 4);
+    assert(stats.bytes_spilled >= expected->num_digits * sizeof(BigInt_digit));
+
+    // the budget bounds what is really allocated, and nothing is kept
+    Tracking_allocator_stats allocated = {0, 0, 0, 0};
+    BigInt_allocator tracking = { tracking_alloc, tracking_realloc, tracking_free, &allocated };
+    BigInt_set_allocator(&tracking);
+    assert(BigInt_assign(product, a));
+    assert(BigInt_multiply_out_of_core(product, b, 512, &stats));
+    BigInt_set_allocator(NULL);
+    assert(BigInt_compare(product, expected) == 0);
+    assert(allocated.total_blocks > 0 && allocated.largest_block <= stats.peak_bytes);
+    assert(stats.peak_bytes <= 512);
+    assert(allocated.blocks == 0);
+
+    // squaring in place, with the budget covering the operands whole
+    assert(BigInt_assign(product, b));
+    assert(BigInt_assign(expected, b));
+    assert(BigInt_multiply(expected, expected));
+    assert(BigInt_multiply_out_of_core(product, product, 1 << 20, NULL));
+    assert(BigInt_compare(product, expected) == 0);
+
+    // multiplying by 0 gives an unsigned 0
+    assert(BigInt_assign_int(product, 0));
+    assert(BigInt_multiply_out_of_core(a, product, 512, NULL));
+    assert(BigInt_compare_int(a, 0) == 0 && !a->is_negative);
+
+    errno = 0;
+    assert(!BigInt_multiply_out_of_core(b, b, 2 * sizeof(BigInt_digit), NULL));
+    assert(errno == EINVAL);
+
+    BigInt_free(a);
+    BigInt_free(b);
+    BigInt_free(expected);
+    BigInt_free(product);
+}
+
+// Returns a new BigInt with num_digits decimal digits from a fixed
+// pseudo-random sequence; nines makes every digit 9, the worst case for
+// carries.
+static BigInt* test_number(unsigned int num_digits, unsigned int seed, int nines) {
+    char* str = malloc(num_digits + 1);
+    assert(str);
+    for(unsigned int i = 0; i < num_digits; i++) {
+        seed = seed * 1103515245 + 12345;
+        str[i] = nines ? '9' : '0' + (seed >> 16) % 10;
+    }
+    str[0] = nines ? '9' : '1' + seed % 9;
+    str[num_digits] = 0;
+    BigInt* big_int = BigInt_from_string(str);
+    assert(big_int);
+    free(str);
+    return big_int;
+}
+
+// Checks that (10^n - 1)^2 = 10^2n - 2 * 10^n + 1, which is 9...980...01.
+static void test_nines_squared(unsigned int n) {
+    BigInt* nines = test_number(n, 0, 1);
+    assert(BigInt_multiply(nines, nines));
+    char* str = BigInt_to_new_string(nines);
+    assert(str && strlen(str) == 2 * n);
+    for(unsigned int i = 0; i < 2 * n; i++) {
+        assert(str[i] == (i < n - 1 ? '9' : i == n - 1 ? '8' : i < 2 * n - 1 ? '0' : '1'));
+    }
+    free(str);
+    BigInt_free(nines);
+}
+
+void BigInt_test_multiply_algorithms() {
+    // products and squares by the faster algorithms must match pencil and
+    // paper for balanced, unbalanced and odd operand shapes
+    static const unsigned int shapes[][2] = {
+        {1, 1}, {3, 70}, {70, 70}, {71, 69}, {150, 37}, {600, 599}, {1200, 250}, {2000, 9},
+    };
+    // Karatsuba, Toom-3, Toom-4 and NTT thresholds; 0 is the default
+    static const size_t thresholds[][4] = {
+        {2, SIZE_MAX, SIZE_MAX, SIZE_MAX},
+        {5, SIZE_MAX, SIZE_MAX, SIZE_MAX},
+        {2, 16, SIZE_MAX, SIZE_MAX},
+        {2, SIZE_MAX, 16, SIZE_MAX},
+        {4, 16, 40, SIZE_MAX},
+        {2, SIZE_MAX, SIZE_MAX, 2},
+        {4, 16, 40, 100},
+        {0, 0, 0, 0},
+    };
+    for(unsigned int shape = 0; shape < sizeof(shapes) / sizeof(shapes[0]); shape++) {
+        for(int nines = 0; nines <= 1; nines++) {
+            BigInt* a = test_number(shapes[shape][0], shape, nines);
+            BigInt* b = test_number(shapes[shape][1], shape + 100, nines);
+            assert(BigInt_multiply_int(b, -1));
+
+            assert(BigInt_set_threshold(BIGINT_THRESHOLD_KARATSUBA, SIZE_MAX));
+            assert(BigInt_set_threshold(BIGINT_THRESHOLD_TOOM3, SIZE_MAX));
+            assert(BigInt_set_threshold(BIGINT_THRESHOLD_TOOM4, SIZE_MAX));
+            assert(BigInt_set_threshold(BIGINT_THRESHOLD_NTT, SIZE_MAX));
+            BigInt* expected = BigInt_clone(a, 0);
+            assert(expected);
+            assert(BigInt_multiply(expected, b));
+            // a general product: the copy has digits of its own
+            BigInt* expected_square = test_number(shapes[shape][1], shape + 100, nines);
+            assert(BigInt_multiply_int(expected_square, -1));
+            assert(BigInt_multiply(expected_square, b));
+
+            for(unsigned int t = 0; t < sizeof(thresholds) / sizeof(thresholds[0]); t++) {
+                assert(BigInt_set_threshold(BIGINT_THRESHOLD_KARATSUBA, thresholds[t][0]));
+                assert(BigInt_set_threshold(BIGINT_THRESHOLD_TOOM3, thresholds[t][1]));
+                assert(BigInt_set_threshold(BIGINT_THRESHOLD_TOOM4, thresholds[t][2]));
+                assert(BigInt_set_threshold(BIGINT_THRESHOLD_NTT, thresholds[t][3]));
+                BigInt* product = BigInt_clone(a, 0);
+                assert(product);
+                assert(BigInt_multiply(product, b));
+                assert(BigInt_compare(product, expected) == 0);
+                BigInt_free(product);
+
+                BigInt* square = BigInt_clone(b, 0);
+                assert(square);
+                assert(BigInt_square(square));
+                assert(BigInt_compare(square, expected_square) == 0);
+                BigInt_free(square);
+            }
+            BigInt_free(a);
+            BigInt_free(b);
+            BigInt_free(expected);
+            BigInt_free(expected_square);
+        }
+    }
+
+    // the pencil and paper method on its own, with long columns of large
+    // digit products, and the defaults on operands large enough for the
+    // fastest algorithm
+    assert(BigInt_set_threshold(BIGINT_THRESHOLD_KARATSUBA, SIZE_MAX));
+    assert(BigInt_set_threshold(BIGINT_THRESHOLD_TOOM3, SIZE_MAX));
+    assert(BigInt_set_threshold(BIGINT_THRESHOLD_TOOM4, SIZE_MAX));
+    assert(BigInt_set_threshold(BIGINT_THRESHOLD_NTT, SIZE_MAX));
+    test_nines_squared(3000);
+    for(int threshold = 0; threshold < BIGINT_THRESHOLD_COUNT; threshold++) {
+        assert(BigInt_set_threshold(threshold, 0));
+    }
+    test_nines_squared(50000);
+
+    assert(BigInt_set_threshold(BIGINT_THRESHOLD_KARATSUBA, 1));
+    assert(BigInt_get_threshold(BIGINT_THRESHOLD_KARATSUBA) == 2);
+    assert(BigInt_set_threshold(BIGINT_THRESHOLD_TOOM3, 3));
+    assert(BigInt_get_threshold(BIGINT_THRESHOLD_TOOM3) == 16);
+    assert(BigInt_set_threshold(BIGINT_THRESHOLD_TOOM3, 0));
+    assert(BigInt_set_threshold(BIGINT_THRESHOLD_KARATSUBA, 0));
+    assert(BigInt_get_threshold(BIGINT_THRESHOLD_KARATSUBA) > 2);
+    errno = 0;
+    assert(!BigInt_set_threshold(BIGINT_THRESHOLD_COUNT, 10));
+    assert(errno == EINVAL);
+}
+
+// Checks that big_int prints as expected.
+static void assert_string(const BigInt* big_int, const char* expected) {
+    char* str = BigInt_to_new_string(big_int);
+    assert(str);
+    assert(!strcmp(str, expected));
+    free(str);
+}
+
+void BigInt_test_int_operations() {
+    // counting up and back down across carries into new digits
+    BigInt* counter = BigInt_construct(0);
+    assert(counter);
+    for(int i = 0; i < 100000; i++) {
+        assert(BigInt_add_int(counter, 1));
+    }
+    assert(BigInt_compare_int(counter, 100000) == 0);
+    for(int i = 0; i < 100000; i++) {
+        assert(BigInt_subtract_int(counter, 1));
+    }
+    assert(BigInt_compare_int(counter, 0) == 0);
+    assert(!counter->is_negative);
+    assert(BigInt_subtract_int(counter, 1));
+    assert(BigInt_compare_int(counter, -1) == 0);
+    assert(BigInt_add_int(counter, 1));
+    assert(BigInt_compare_int(counter, 0) == 0);
+    assert(!counter->is_negative);
+
+    // crossing zero in either direction
+    assert(BigInt_assign_int(counter, 5));
+    assert(BigInt_subtract_int(counter, 7));
+    assert(BigInt_compare_int(counter, -2) == 0);
+    assert(BigInt_add_int(counter, 1000000007));
+    assert(BigInt_compare_int(counter, 1000000005) == 0);
+    assert(BigInt_add_int(counter, -1000000005));
+    assert(BigInt_compare_int(counter, 0) == 0);
+    assert(!counter->is_negative);
+
+    // the extremes of int, carried and borrowed across many digits
+    assert(BigInt_assign_int(counter, INT_MIN));
+    assert(BigInt_subtract_int(counter, INT_MIN));
+    assert(BigInt_compare_int(counter, 0) == 0);
+    assert(BigInt_subtract_int(counter, INT_MIN));
+    assert(BigInt_add_int(counter, INT_MAX));
+    assert_string(counter, "4294967295");
+    BigInt* big = BigInt_from_string("1000000000000000000000000000000000000000");
+    assert(big);
+    assert(BigInt_subtract_int(big, INT_MAX));
+    assert_string(big, "999999999999999999999999999997852516353");
+    assert(BigInt_add_int(big, INT_MAX));
+    assert(BigInt_subtract_int(big, INT_MIN));
+    assert_string(big, "1000000000000000000000000000002147483648");
+    assert(BigInt_multiply_int(big, -1));
+    assert(BigInt_add_int(big, INT_MIN));
+    assert_string(big, "-1000000000000000000000000000004294967296");
+
+    // multiplying by a word in one pass
+    assert(BigInt_multiply_int(big, INT_MIN));
+    assert_string(big, "2147483648000000000000000000009223372036854775808");
+    assert(BigInt_multiply_int(big, -INT_MAX));
+    assert_string(big, "-4611686016279904256000000000019807040619342712361531211776");
+    assert(BigInt_multiply_int(big, 0));
+    assert(BigInt_compare_int(big, 0) == 0);
+    assert(!big->is_negative);
+    assert(BigInt_multiply_int(big, -3));
+    assert(BigInt_compare_int(big, 0) == 0);
+    assert(!big->is_negative);
+
+    // incrementing a full fixed buffer works while the carry stays inside it
+    BigInt_digit buffer[4];
+    BigInt fixed;
+    BigInt_init_with_buffer(&fixed, buffer, 4, BIGINT_BUFFER_FIXED);
+    assert(BigInt_add_int(&fixed, 1));
+    while(fixed.num_digits < 4) {
+        assert(BigInt_multiply_int(&fixed, 2));
+    }
+    assert(BigInt_add_int(&fixed, 1));
+    assert(fixed.num_digits == 4);
+    assert(BigInt_subtract_int(&fixed, 2));
+    BigInt_release(&fixed);
+
+    // a copy-on-write clone is left alone
+    BigInt* original = BigInt_from_string("123456789012345678901234567890123456789012345678901234567890");
+    assert(original);
+    BigInt* clone = BigInt_clone(original, 0);
+    assert(clone);
+    assert(BigInt_add_int(clone, 10));
+    assert(BigInt_subtract_int(original, 10));
+    assert(BigInt_multiply_int(original, 3));
+    assert_string(clone, "123456789012345678901234567890123456789012345678901234567900");
+    assert_string(original, "370370367037037036703703703670370370367037037036703703703640");
+
+    // dividing by an int matches BigInt_divide, for divisors above and
+    // below the base of every representation
+    static const int divisors[] = {1, -1, 2, -3, 7, 10, 99, 100, 1000000007, -1000000000, INT_MAX, INT_MIN};
+    for(unsigned int length = 1; length < 200; length += 33) {
+        for(int sign = 0; sign < 2; sign++) {
+            for(unsigned int d = 0; d < sizeof(divisors) / sizeof(divisors[0]); d++) {
+                BigInt* dividend = test_number(length, length + d, 0);
+                BigInt* divisor = BigInt_construct(divisors[d]);
+                BigInt* expected_quotient = BigInt_construct(0);
+                BigInt* expected_remainder = BigInt_construct(0);
+                assert(dividend && divisor && expected_quotient && expected_remainder);
+                if(sign) {
+                    assert(BigInt_multiply_int(dividend, -1));
+                }
+                assert(BigInt_divide(dividend, divisor, expected_quotient, expected_remainder));
+
+                int mod;
+                assert(BigInt_mod_int(dividend, divisors[d], &mod));
+                assert(BigInt_compare_int(expected_remainder, mod) == 0);
+                int remainder;
+                assert(BigInt_divide_int(dividend, divisors[d], &remainder));
+                assert(remainder == mod);
+                assert(BigInt_compare(dividend, expected_quotient) == 0);
+
+                BigInt_free(dividend);
+                BigInt_free(divisor);
+                BigInt_free(expected_quotient);
+                BigInt_free(expected_remainder);
+            }
+        }
+    }
+    int remainder;
+    assert(BigInt_assign_int(counter, -7));
+    assert(BigInt_divide_int(counter, 2, &remainder));
+    assert(BigInt_compare_int(counter, -3) == 0 && remainder == -1);
+    assert(BigInt_divide_int(counter, -4, NULL));
+    assert(BigInt_compare_int(counter, 0) == 0);
+    assert(!counter->is_negative);
+    assert(BigInt_assign_int(counter, INT_MIN));
+    assert(BigInt_divide_int(counter, INT_MIN, &remainder));
+    assert(BigInt_compare_int(counter, 1) == 0 && remainder == 0);
+    errno = 0;
+    assert(!BigInt_divide_int(counter, 0, &remainder));
+    assert(errno == ERANGE);
+    errno = 0;
+    assert(!BigInt_mod_int(counter, 0, &remainder));
+    assert(errno == ERANGE);
+    errno = 0;
+    assert(!BigInt_mod_int(counter, 0, NULL));
+    assert(errno == ERANGE);
+    assert(BigInt_mod_int(counter, 7, NULL));
+
+    // dividing a clone in place leaves the original alone
+    BigInt* shared = BigInt_clone(original, 0);
+    assert(shared);
+    assert(BigInt_divide_int(shared, 1000, &remainder));
+    assert(remainder == 640);
+    assert_string(shared, "370370367037037036703703703670370370367037037036703703703");
+    assert_string(original, "370370367037037036703703703670370370367037037036703703703640");
+    BigInt_free(shared);
+
+    BigInt_free(counter);
+    BigInt_free(big);
+    BigInt_free(original);
+    BigInt_free(clone);
+}
+
 void BigInt_test_strings() {
     int value;
 
@@ -189,6 +1164,56 @@ void BigInt_test_strings() {
     assert(BigInt_to_int(big_int, &value));
     assert(value == 0);
     BigInt_free(big_int);
+
+    // values around the boundaries of the internal digit sizes should
+    // survive a round trip through every representation:
+    const char* round_trips[] = {
+        "9999999999999999999",
+        "10000000000000000000",
+        "18446744073709551615",
+        "18446744073709551616",
+        "-340282366920938463463374607431768211456",
+        "123456789012345678901234567890123456789012345678901234567890",
+    };
+    for(unsigned int i = 0; i < sizeof(round_trips) / sizeof(round_trips[0]); i++) {
+        big_int = BigInt_from_string(round_trips[i]);
+        assert(big_int);
+        str = BigInt_to_new_string(big_int);
+        assert(str);
+        assert(!strcmp(str, round_trips[i]));
+        assert(BigInt_strlen(big_int) == strlen(round_trips[i]));
+        free(str);
+        BigInt_free(big_int);
+    }
+
+    big_int = BigInt_from_string("-2147483648");
+    assert(big_int);
+    assert(BigInt_to_int(big_int, &value));
+    assert(value == -2147483647 - 1);
+    BigInt_free(big_int);
+
+    big_int = BigInt_from_string("2147483648");
+    assert(big_int);
+    assert(!BigInt_to_int(big_int, &value));
+    BigInt_free(big_int);
+
+    assert(!BigInt_from_string("12x4"));
+    assert(errno == EINVAL);
+
+#if BIGINT_REPR == BIGINT_REPR_PACKED_BCD
+    // two digits per byte, less significant digit in the low nibble; carries
+    // and borrows must ripple across nibbles and bytes
+    big_int = BigInt_from_string("12345");
+    assert(big_int);
+    assert(big_int->num_digits == 3);
+    assert(big_int->digits[0] == 0x45 && big_int->digits[1] == 0x23 && big_int->digits[2] == 0x01);
+    assert(BigInt_add_int(big_int, 87655));
+    assert(big_int->num_digits == 3);
+    assert(big_int->digits[0] == 0x00 && big_int->digits[1] == 0x00 && big_int->digits[2] == 0x10);
+    assert(BigInt_subtract_int(big_int, 1));
+    assert(big_int->digits[0] == 0x99 && big_int->digits[1] == 0x99 && big_int->digits[2] == 0x09);
+    BigInt_free(big_int);
+#endif
 }
 
 void _BigInt_test_division( const char* dividend, const char* divisor, const char* quotient, const char* remainder ) {
@@ -216,6 +1241,22 @@ void _BigInt_test_division( const char* dividend, const char* divisor, const cha
 	free(remainder2);
 }
 
+// Checks that quotient * divisor + remainder == dividend, with the
+// remainder smaller than the divisor and of the dividend's sign.
+static void test_division_identity(BigInt* dividend, BigInt* divisor) {
+	BigInt* quotient = BigInt_construct(0);
+	BigInt* remainder = BigInt_construct(0);
+	assert(quotient && remainder);
+	assert(BigInt_divide(dividend, divisor, quotient, remainder));
+	assert(BigInt_compare_digits(remainder, divisor) < 0);
+	assert(BigInt_compare_int(remainder, 0) == 0 || remainder->is_negative == dividend->is_negative);
+	assert(BigInt_multiply(quotient, divisor));
+	assert(BigInt_add(quotient, remainder));
+	assert(BigInt_compare(quotient, dividend) == 0);
+	BigInt_free(quotient);
+	BigInt_free(remainder);
+}
+
 void BigInt_test_division() {
 	// basic division:
 	_BigInt_test_division( "1000", "10", "100", "0" );
@@ -226,6 +1267,331 @@ void BigInt_test_division() {
 	
 	// test remainder:
 	_BigInt_test_division( "10", "3", "3", "1" );
+
+	// quotient digits that span a whole limb:
+	_BigInt_test_division( "340282366920938463463374607431768211455", "18446744073709551617", "18446744073709551615", "0" );
+	_BigInt_test_division( "123456789012345678901234567890123456789", "98765432109876543210", "1249999988609375000", "15297067891529706789" );
+
+	// the quotient is truncated toward zero and the remainder takes the
+	// sign of the dividend:
+	_BigInt_test_division( "-10", "3", "-3", "-1" );
+	_BigInt_test_division( "10", "-3", "-3", "1" );
+	_BigInt_test_division( "-10", "-3", "3", "-1" );
+	_BigInt_test_division( "-9", "3", "-3", "0" );
+	_BigInt_test_division( "-3", "10", "0", "-3" );
+	_BigInt_test_division( "3", "-100000000000000000000000000000", "0", "3" );
+
+	// quotient digit estimates that need correcting:
+	_BigInt_test_division( "99999999999999999999999999999999999999999999999999", "99999999999999999999999", "1000000000000000000000010000", "9999" );
+	_BigInt_test_division( "340282366920938463463374607431768211456", "18446744073709551615", "18446744073709551617", "1" );
+
+	// estimates one too large even after correction, so the divisor is added
+	// back (in base 2^64, 10^19, 10^9 and 100 respectively):
+	_BigInt_test_division( "1067993517960455041255406897703434155013137753682670338900155796243930144910049067015437608288257", "3138550867693340381917894711603833208088071210379436359679", "340282366920938463481821351505477763067", "3138550867693340381577612344682894744790717299611054112764" );
+	_BigInt_test_division( "49999999999999999990000000000000000000000000000000000000000000000000000000015000000000000000000", "500000000000000000000000000000000000000000000000000000001", "99999999999999999979999999999999999999", "499999999999999999900000000000000000035000000000000000001" );
+	_BigInt_test_division( "500000000999999999000000001000000000", "500000000999999999999999999", "999999999", "500000000000000001999999999" );
+	_BigInt_test_division( "9950500050", "995082", "9999", "675132" );
+
+	// q * divisor + r == dividend with |r| < |divisor| over a range of
+	// shapes, including all nines, which stresses the estimates
+	for(int nines = 0; nines < 2; nines++) {
+		for(unsigned int nu = 1; nu < 300; nu += 37) {
+			for(unsigned int nv = 1; nv <= nu + 3; nv += 13) {
+				BigInt* dividend = test_number(nu, nu, nines);
+				BigInt* divisor = test_number(nv, 7 * nv + 1, 0);
+				if(nv % 2) {
+					assert(BigInt_multiply_int(dividend, -1));
+				}
+				test_division_identity(dividend, divisor);
+				BigInt_free(dividend);
+				BigInt_free(divisor);
+			}
+		}
+	}
+
+	// recursive division must match long division, down to its smallest
+	// threshold, and hold up on operands well past the default threshold
+	static const unsigned int shapes[][2] = {
+		{30, 12}, {100, 40}, {200, 199}, {401, 150}, {1000, 300}, {2000, 1000}, {3000, 60},
+	};
+	static const size_t thresholds[] = {4, 5, 9, 16, 0};
+	for(unsigned int shape = 0; shape < sizeof(shapes) / sizeof(shapes[0]); shape++) {
+		for(int nines = 0; nines < 2; nines++) {
+			BigInt* dividend = test_number(shapes[shape][0], shape, nines);
+			BigInt* divisor = test_number(shapes[shape][1], shape + 100, nines && shape % 2);
+			BigInt* expected_quotient = BigInt_construct(0);
+			BigInt* expected_remainder = BigInt_construct(0);
+			assert(expected_quotient && expected_remainder);
+			assert(BigInt_set_threshold(BIGINT_THRESHOLD_DIVIDE, SIZE_MAX));
+			assert(BigInt_divide(dividend, divisor, expected_quotient, expected_remainder));
+			for(unsigned int t = 0; t < sizeof(thresholds) / sizeof(thresholds[0]); t++) {
+				assert(BigInt_set_threshold(BIGINT_THRESHOLD_DIVIDE, thresholds[t]));
+				BigInt* quotient = BigInt_construct(0);
+				BigInt* remainder = BigInt_construct(0);
+				assert(quotient && remainder);
+				assert(BigInt_divide(dividend, divisor, quotient, remainder));
+				assert(BigInt_compare(quotient, expected_quotient) == 0);
+				assert(BigInt_compare(remainder, expected_remainder) == 0);
+				BigInt_free(quotient);
+				BigInt_free(remainder);
+			}
+			BigInt_free(dividend);
+			BigInt_free(divisor);
+			BigInt_free(expected_quotient);
+			BigInt_free(expected_remainder);
+		}
+	}
+	// all top digits equal to the divisor's, in every representation:
+	// 10^n - 1 is all nines in the decimal ones when 171 divides n, and
+	// 2^n - 1 all ones in binary64 when 64 does
+	assert(BigInt_set_threshold(BIGINT_THRESHOLD_DIVIDE, 4));
+	for(int binary = 0; binary < 2; binary++) {
+		BigInt* dividend = binary ? BigInt_construct(1) : test_number(1710, 0, 1);
+		BigInt* divisor = binary ? BigInt_construct(1) : test_number(684, 0, 1);
+		assert(dividend && divisor);
+		if(binary) {
+			for(int i = 0; i < 5120; i++) {
+				assert(BigInt_multiply_int(dividend, 2));
+				if(i < 2048) {
+					assert(BigInt_multiply_int(divisor, 2));
+				}
+			}
+			assert(BigInt_subtract_int(dividend, 1));
+			assert(BigInt_subtract_int(divisor, 1));
+		}
+		test_division_identity(dividend, divisor);
+		assert(BigInt_multiply(dividend, divisor));
+		assert(BigInt_add(dividend, divisor));
+		assert(BigInt_subtract_int(dividend, 1));
+		test_division_identity(dividend, divisor);
+		BigInt_free(dividend);
+		BigInt_free(divisor);
+	}
+	assert(BigInt_set_threshold(BIGINT_THRESHOLD_DIVIDE, 0));
+
+	BigInt* dividend = test_number(60000, 1, 0);
+	BigInt* divisor = test_number(25000, 2, 0);
+	test_division_identity(dividend, divisor);
+	BigInt_free(dividend);
+	BigInt_free(divisor);
+
+	// exact division by ints and BigInts: (x * y) / y == x, for divisors
+	// with and without factors in common with the base
+	static const int int_divisors[] = {1, -1, 2, 3, -7, 10, 16, 25, 390625, 1 << 30, 1000000007, INT_MAX, INT_MIN};
+	for(unsigned int length = 1; length < 120; length += 29) {
+		for(unsigned int d = 0; d < sizeof(int_divisors) / sizeof(int_divisors[0]); d++) {
+			BigInt* x = test_number(length, length + d, d % 2);
+			BigInt* product = BigInt_clone(x, 0);
+			assert(product);
+			assert(BigInt_multiply_int(product, int_divisors[d]));
+			assert(BigInt_divexact_int(product, int_divisors[d]));
+			assert(BigInt_compare(product, x) == 0);
+			BigInt_free(x);
+			BigInt_free(product);
+		}
+	}
+	// Hensel division, and the recursive division it hands large ones to
+	for(int recursive = 0; recursive < 2; recursive++) {
+		assert(BigInt_set_threshold(BIGINT_THRESHOLD_DIVIDE, recursive ? 4 : SIZE_MAX));
+		for(unsigned int shape = 0; shape < sizeof(shapes) / sizeof(shapes[0]); shape++) {
+			for(int variant = 0; variant < 4; variant++) {
+				BigInt* x = test_number(shapes[shape][0] / 2 + 1, shape, variant == 1);
+				BigInt* y = test_number(shapes[shape][1] / 2 + 1, shape + 100, 0);
+				if(variant >= 2) {
+					// factors and whole digits in common with the base
+					for(int i = 0; i < 70; i++) {
+						assert(BigInt_multiply_int(y, variant == 2 ? 2 : 5));
+					}
+					assert(BigInt_multiply_int(y, -1000000000));
+				}
+				BigInt* product = BigInt_clone(x, 0);
+				assert(product);
+				assert(BigInt_multiply(product, y));
+				assert(BigInt_divexact(product, y));
+				assert(BigInt_compare(product, x) == 0);
+				assert(BigInt_divexact(y, y));
+				assert(BigInt_compare_int(y, 1) == 0);
+				BigInt_free(x);
+				BigInt_free(y);
+				BigInt_free(product);
+			}
+		}
+	}
+	assert(BigInt_set_threshold(BIGINT_THRESHOLD_DIVIDE, 0));
+	// binomial coefficients, one exact division per term
+	BigInt* binomial = BigInt_construct(1);
+	assert(binomial);
+	for(int i = 0; i < 500; i++) {
+		assert(BigInt_multiply_int(binomial, 1000 - i));
+		assert(BigInt_divexact_int(binomial, i + 1));
+		if(i == 49) {
+			BigInt* expected = BigInt_from_string("100891344545564193334812497256");
+			BigInt* check = BigInt_construct(1);
+			assert(expected && check);
+			for(int j = 0; j < 50; j++) {
+				assert(BigInt_multiply_int(check, 100 - j));
+			}
+			BigInt* factorial = BigInt_construct(1);
+			assert(factorial);
+			for(int j = 2; j <= 50; j++) {
+				assert(BigInt_multiply_int(factorial, j));
+			}
+			assert(BigInt_divexact(check, factorial));
+			assert(BigInt_compare(check, expected) == 0);
+			BigInt_free(expected);
+			BigInt_free(check);
+			BigInt_free(factorial);
+		}
+	}
+	int low;
+	assert(BigInt_mod_int(binomial, 100000, &low));
+	assert(low == 16320);
+	BigInt_free(binomial);
+	BigInt* zero = BigInt_construct(0);
+	BigInt* ten = BigInt_construct(-10);
+	assert(zero && ten);
+	assert(BigInt_divexact(zero, ten));
+	assert(BigInt_compare_int(zero, 0) == 0 && !zero->is_negative);
+	errno = 0;
+	assert(!BigInt_divexact(ten, zero));
+	assert(errno == ERANGE);
+	errno = 0;
+	assert(!BigInt_divexact_int(ten, 0));
+	assert(errno == ERANGE);
+	BigInt_free(zero);
+	BigInt_free(ten);
+
+	assert(BigInt_set_threshold(BIGINT_THRESHOLD_DIVIDE, 1));
+	assert(BigInt_get_threshold(BIGINT_THRESHOLD_DIVIDE) == 4);
+	assert(BigInt_set_threshold(BIGINT_THRESHOLD_DIVIDE, 0));
+}
+
+// Returns base^exponent mod |modulus| by square and multiply with
+// BigInt_multiply and BigInt_divide, to check BigInt_powmod against.
+static BigInt* test_powmod_naive(const BigInt* base, const BigInt* exponent, const BigInt* modulus) {
+    BigInt* m = BigInt_clone(modulus, 0);
+    BigInt* power = BigInt_clone(base, 0);
+    BigInt* e = BigInt_clone(exponent, 0);
+    BigInt* result = BigInt_construct(1);
+    assert(m && power && e && result);
+    m->is_negative = 0;
+    assert(BigInt_divide(result, m, NULL, result));
+    while(BigInt_compare_int(e, 0)) {
+        int bit;
+        assert(BigInt_divide_int(e, 2, &bit));
+        if(bit) {
+            assert(BigInt_multiply(result, power));
+            assert(BigInt_divide(result, m, NULL, result));
+        }
+        assert(BigInt_square(power));
+        assert(BigInt_divide(power, m, NULL, power));
+    }
+    if(result->is_negative) {
+        assert(BigInt_add(result, m));
+    }
+    BigInt_free(m);
+    BigInt_free(power);
+    BigInt_free(e);
+    return result;
+}
+
+static void test_powmod(const BigInt* base, const BigInt* exponent, const BigInt* modulus) {
+    BigInt* expected = test_powmod_naive(base, exponent, modulus);
+    BigInt* result = BigInt_construct(0);
+    assert(result);
+    assert(BigInt_powmod(result, base, exponent, modulus));
+    assert(BigInt_compare(result, expected) == 0);
+    BigInt_free(expected);
+    BigInt_free(result);
+}
+
+void BigInt_test_powmod() {
+    static const int bases[] = {0, 1, 2, -3, 10, 12345, -99999999};
+    static const int exponents[] = {0, 1, 2, 3, 10, 127, 128, 65537, INT_MAX};
+    static const char* moduli[] = {
+        "1", "2", "-7", "10", "100", "97", "1000000007", "4294967296",
+        "1000000000000000000", "18446744073709551616", "18446744073709551629", "10000000000000000000",
+        "100000000000000000000000000000000000000", "340282366920938463463374607431768211456",
+        "-123456789012345678901234567890123456789012345678901234567890",
+    };
+    for(unsigned int b = 0; b < sizeof(bases) / sizeof(bases[0]); b++) {
+        for(unsigned int e = 0; e < sizeof(exponents) / sizeof(exponents[0]); e++) {
+            for(unsigned int m = 0; m < sizeof(moduli) / sizeof(moduli[0]); m++) {
+                BigInt* base = BigInt_construct(bases[b]);
+                BigInt* exponent = BigInt_construct(exponents[e]);
+                BigInt* modulus = BigInt_from_string(moduli[m]);
+                assert(base && exponent && modulus);
+                test_powmod(base, exponent, modulus);
+                BigInt_free(base);
+                BigInt_free(exponent);
+                BigInt_free(modulus);
+            }
+        }
+    }
+
+    // long operands, every window width, and the multiplication algorithms
+    // underneath the reduction
+    static const unsigned int lengths[][3] = {
+        {30, 2, 25}, {50, 8, 40}, {60, 25, 50}, {100, 75, 60}, {20, 210, 30},
+    };
+    // Karatsuba, Toom-3, Toom-4 and NTT thresholds; 0 is the default
+    static const size_t thresholds[][4] = {
+        {2, SIZE_MAX, SIZE_MAX, SIZE_MAX},
+        {2, 16, 40, SIZE_MAX},
+        {2, SIZE_MAX, SIZE_MAX, 2},
+        {0, 0, 0, 0},
+    };
+    for(unsigned int t = 0; t < sizeof(thresholds) / sizeof(thresholds[0]); t++) {
+        for(int i = 0; i < 4; i++) {
+            assert(BigInt_set_threshold(i, thresholds[t][i]));
+        }
+        for(unsigned int l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            BigInt* base = test_number(lengths[l][0], l, 0);
+            BigInt* exponent = test_number(lengths[l][1], l + 10, 0);
+            BigInt* modulus = test_number(lengths[l][2], l + 20, t % 2);
+            test_powmod(base, exponent, modulus);
+            BigInt_free(base);
+            BigInt_free(exponent);
+            BigInt_free(modulus);
+        }
+    }
+
+    // Fermat's little theorem for the Mersenne prime 2^521 - 1
+    BigInt* prime = BigInt_construct(1);
+    assert(prime);
+    for(int i = 0; i < 521; i++) {
+        assert(BigInt_multiply_int(prime, 2));
+    }
+    assert(BigInt_subtract_int(prime, 1));
+    BigInt* exponent = BigInt_clone(prime, 0);
+    BigInt* result = BigInt_construct(3);
+    assert(exponent && result);
+    assert(BigInt_subtract_int(exponent, 1));
+    assert(BigInt_powmod(result, result, exponent, prime));
+    assert(BigInt_compare_int(result, 1) == 0);
+    // and 2 is a square modulo p, since p = 7 mod 8, so 2^((p - 1) / 2) = 1;
+    // result may be the exponent or the modulus
+    assert(BigInt_divide_int(exponent, 2, NULL));
+    assert(BigInt_assign_int(result, 2));
+    assert(BigInt_powmod(exponent, result, exponent, prime));
+    assert(BigInt_compare_int(exponent, 1) == 0);
+    assert(BigInt_assign_int(exponent, 10));
+    assert(BigInt_powmod(prime, result, exponent, prime));
+    assert(BigInt_compare_int(prime, 1024) == 0);
+
+    BigInt* zero = BigInt_construct(0);
+    assert(zero);
+    errno = 0;
+    assert(!BigInt_powmod(result, result, exponent, zero));
+    assert(errno == ERANGE);
+    assert(BigInt_assign_int(exponent, -1));
+    errno = 0;
+    assert(!BigInt_powmod(result, result, exponent, prime));
+    assert(errno == EINVAL);
+    BigInt_free(zero);
+    BigInt_free(prime);
+    BigInt_free(exponent);
+    BigInt_free(result);
 }
 
 void BigInt_test_operations(int a, int b) {
@@ -347,7 +1713,7 @@ void BigInt_test_print() {
     assert(big_int);
     assert(BigInt_subtract_int(big_int, 9900));
 
-    printf("num_digits=%d, alloc_digits=%d, should output '100': ", big_int->num_digits, big_int->num_allocated_digits);
+    printf("num_digits=%zu, alloc_digits=%zu, should output '100': ", big_int->num_digits, big_int->num_allocated_digits);
     BigInt_print(big_int);
     printf("\n");
     BigInt_free(big_int);
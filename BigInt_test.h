@@ -30,6 +30,17 @@ void BigInt_test_construct(int value);
 void BigInt_test_signs();
 void BigInt_test_multiply_optimized();
 void BigInt_test_strings();
+void BigInt_test_inline_storage();
+void BigInt_test_allocator();
+void BigInt_test_scratch_arena();
+void BigInt_test_digit_cache();
+void BigInt_test_caller_storage();
+void BigInt_test_move_swap();
+void BigInt_test_copy_on_write();
+void BigInt_test_mapped();
+void BigInt_test_out_of_core();
+void BigInt_test_multiply_algorithms();
+void BigInt_test_int_operations();
 void BigInt_test_operations(int a, int b);
 void BigInt_test_permutations(Generic_function BigInt_operation_to_test,
         OPERATION_TYPE operation_type, int a, int b); 
@@ -37,6 +48,7 @@ void BigInt_test_single_operation(Generic_function BigInt_operation_to_test,
         OPERATION_TYPE operation_type, int a, int b);
 void BigInt_test_print();
 void BigInt_test_division();
+void BigInt_test_powmod();
 
 #endif // BIG_INT_TEST_H
 
@@ -0,0 +1,95 @@
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "BigInt.h"
+
+// Rough timings of the digit kernels for whichever representation BigInt.c
+// was compiled with (see BIGINT_REPR); run "make bench" to compare them.
+
+static const char* repr_name() {
+    switch(BIGINT_REPR) {
+        case BIGINT_REPR_DECIMAL: return "decimal";
+        case BIGINT_REPR_BINARY64: return "binary64";
+        case BIGINT_REPR_BASE1E9: return "base1e9";
+        case BIGINT_REPR_BASE1E19: return "base1e19";
+        case BIGINT_REPR_PACKED_BCD: return "bcd";
+        default: return "unknown";
+    }
+}
+
+// Returns a new BigInt with num_digits pseudo-random decimal digits.
+static BigInt* random_big_int(unsigned int num_digits) {
+    char* str = malloc(num_digits + 1);
+    assert(str);
+    str[0] = '1' + rand() % 9;
+    for(unsigned int i = 1; i < num_digits; i++) {
+        str[i] = '0' + rand() % 10;
+    }
+    str[num_digits] = 0;
+    BigInt* big_int = BigInt_from_string(str);
+    assert(big_int);
+    free(str);
+    return big_int;
+}
+
+static double seconds_since(clock_t start) {
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void bench_size(unsigned int num_digits, unsigned int iterations) {
+    BigInt* a = random_big_int(num_digits);
+    BigInt* b = random_big_int(num_digits);
+    BigInt* accumulator = BigInt_construct(0);
+    assert(accumulator);
+
+    clock_t start = clock();
+    for(unsigned int i = 0; i < iterations; i++) {
+        assert(BigInt_add(accumulator, a));
+    }
+    double add = seconds_since(start);
+
+    start = clock();
+    for(unsigned int i = 0; i < iterations; i++) {
+        assert(BigInt_subtract(accumulator, b));
+    }
+    double subtract = seconds_since(start);
+
+    start = clock();
+    unsigned int multiplications = iterations / num_digits + 1;
+    for(unsigned int i = 0; i < multiplications; i++) {
+        BigInt* product = BigInt_clone(a, 0);
+        assert(product);
+        assert(BigInt_multiply(product, b));
+        BigInt_free(product);
+    }
+    double multiply = seconds_since(start);
+
+    size_t buf_size = BigInt_strlen(accumulator) + 1;
+    char* buf = malloc(buf_size);
+    assert(buf);
+    start = clock();
+    for(unsigned int i = 0; i < iterations; i++) {
+        assert(BigInt_to_string(accumulator, buf, buf_size));
+    }
+    double to_string = seconds_since(start);
+    free(buf);
+
+    printf("%-9s %7u digits: add %8.4fs  subtract %8.4fs  multiply(x%u) %8.4fs  to_string %8.4fs\n",
+            repr_name(), num_digits, add, subtract, multiplications, multiply, to_string);
+
+    BigInt_free(a);
+    BigInt_free(b);
+    BigInt_free(accumulator);
+}
+
+int main() {
+    srand(42);
+    bench_size(100, 100000);
+    bench_size(1000, 10000);
+    bench_size(10000, 1000);
+    return 0;
+}